@@ -0,0 +1,153 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <optional>
+#include <vector>
+#include "structures.hpp"
+
+/**
+ * Mutable solution for annealing chains. Routes are edited in place and the route distances,
+ * the loads after every stop and the position of every node are kept up to date, together with
+ * the sums the fairness measures need. A proposal is priced from the few edges it changes and
+ * checked over at most MAX_SPAN stops; applying it touches the stretch it moved.
+ *
+ * Moves: swap two stops of a route, reverse a stretch of a route (2-opt), and move a request to
+ * another route. Only feasible moves are proposed, so the state never leaves the feasible set.
+ */
+class AnnealingState
+{
+public:
+    // Farthest two stops of a route a move may touch, e.g. the ends of a reversed stretch.
+    static constexpr int MAX_SPAN = 32;
+
+    struct Move
+    {
+        enum Type : uint8_t
+        {
+            SWAP,     // stops a < b of route
+            TWO_OPT,  // reverse stops [a, b] of route
+            RELOCATE, // request at stops a < b of route goes before stops c <= e of to_route
+        };
+
+        Type type;
+        int route;
+        int a;
+        int b;
+        int to_route;
+        int c;
+        int e;
+        double route_distance;    // of route after the move
+        double to_route_distance; // of to_route after the move
+        double delta;             // objective change
+    };
+
+    AnnealingState(Instance const &I, Solution const &sol);
+
+    /**
+     * Draws one random move and returns it if it is feasible and its delta is below threshold.
+     * The delta is priced before the feasibility scan, so rejected moves cost O(1). Pass
+     * infinity to get any feasible move.
+     */
+    std::optional<Move> propose(rng::Engine &rng, double threshold) const;
+    void apply(Move const &mov);
+
+    // Metropolis test without exp: a move is accepted iff its delta < -T log(u), u uniform in (0, 1].
+    static double acceptance_threshold(double T, rng::Engine &rng)
+    {
+        double u = 1.0 - (double)(rng() >> 11) * 0x1.0p-53;
+        return -T * std::log(u);
+    }
+
+    double objective() const { return f; }
+    size_t num_nodes() const { return served_nodes; }
+    Solution solution() const;
+    // Copies into sol, reusing its storage.
+    void write_solution(Solution &sol) const;
+    // Recomputes the running sums from the route distances, dropping rounding drift.
+    void refresh();
+
+private:
+    enum class Fairness
+    {
+        JAIN,
+        GINI,
+        MAXMIN,
+    };
+
+    Instance const *I;
+    Fairness fairness;
+    std::string fairness_name;
+
+    gt::Matrix<int> routes;
+    gt::Matrix<int> loads; // load after each stop
+    std::vector<double> dists;
+    std::vector<int> route_of; // -1 if the node is not served
+    std::vector<int> pos_of;
+    size_t served_nodes = 0;
+
+    double sum = 0.0;        // of the route distances
+    double sum_squares = 0.0;
+    double gini_sum = 0.0;   // sum of |d_i - d_j| over i < j, gini only
+    double f = 0.0;
+
+    struct Sums
+    {
+        double sum;
+        double squares;
+        double gini;
+    };
+
+    std::optional<Move> propose_swap(rng::Engine &rng, double threshold) const;
+    std::optional<Move> propose_two_opt(rng::Engine &rng, double threshold) const;
+    std::optional<Move> propose_relocate(rng::Engine &rng, double threshold) const;
+
+    // Running sums, and objective, if route r1 (and r2 unless -1) had the given distances.
+    Sums sums_with(int r1, double d1, int r2, double d2) const;
+    double objective_with(int r1, double d1, int r2, double d2) const;
+    // Sum of |value - d_j| over all routes j other than skip1 and skip2.
+    double abs_diff_sum(double value, int skip1, int skip2) const;
+
+    int load_before(int r, int pos) const { return pos > 0 ? loads[r][pos - 1] : 0; }
+    int node_at(int r, int pos) const
+    {
+        return pos >= 0 && pos < (int)routes[r].size() ? routes[r][pos] : 0;
+    }
+    void reindex(int r, int from, int to); // positions and loads of stops [from, to)
+};
+
+/**
+ * AnnealingState that remembers its best solution. The best is base + trail[0, best_len), or
+ * best if best_len is 0; the trail holds the moves accepted since base and is folded back into
+ * base (one copy) once it is as long as the solution, so keeping the best costs O(1) per
+ * accepted move instead of a solution copy per improvement.
+ */
+class AnnealingChain
+{
+public:
+    enum Step
+    {
+        REJECTED,
+        ACCEPTED,
+        IMPROVED, // accepted and a new best of the chain
+    };
+
+    AnnealingChain(Instance const &I, Solution const &sol);
+
+    // One Metropolis step at temperature T.
+    Step step(rng::Engine &rng, double T);
+    // Applies a move proposed by state(). Returns true on a new best.
+    bool apply(AnnealingState::Move const &mov);
+
+    AnnealingState const &state() const { return current; }
+    double best_objective() const { return best_f; }
+    Solution best_solution() const;
+
+private:
+    AnnealingState current;
+    AnnealingState base;
+    AnnealingState best;
+    std::vector<AnnealingState::Move> trail;
+    size_t best_len = 0;
+    size_t max_trail;
+    double best_f;
+};
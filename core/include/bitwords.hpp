@@ -0,0 +1,25 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * Kernels over arrays of 64 bit words, as used by the per-vehicle bitsets of Encoding. Each
+ * kernel has an AVX2 version that is picked at runtime when the CPU supports it, and a scalar
+ * fallback otherwise, so the library itself is still built for the baseline target.
+ */
+namespace bitwords
+{
+    // True if the AVX2 versions are in use.
+    bool avx2_enabled();
+
+    // Number of set bits in words[0, num_words).
+    size_t popcount(uint64_t const *words, size_t num_words);
+
+    /**
+     * For rows rows of num_words words each (row major):
+     * dst[row][w] = (a[row][w] & take_a[w]) | (b[row][w] & take_b[w]).
+     * take_a and take_b hold one word per column and are shared by all rows.
+     */
+    void blend_rows(uint64_t *dst, uint64_t const *a, uint64_t const *b,
+                    uint64_t const *take_a, uint64_t const *take_b, size_t rows, size_t num_words);
+};
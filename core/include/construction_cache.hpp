@@ -0,0 +1,37 @@
+#pragma once
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include "structures.hpp"
+
+/**
+ * Process wide memo of construction heuristics whose result only depends on the instance and
+ * their parameters: beam search, and DC with a seeded k-means. GA seeding, restarts and
+ * pipelines that run several methods on one instance build each of them once. A key asked for
+ * by several threads at once is built by the first one, the others wait for it.
+ */
+class ConstructionCache
+{
+public:
+    static ConstructionCache &global();
+
+    // BS::beam_search(I, alpha, beam_width).
+    Solution beam_search(Instance const &I, double alpha, int beam_width);
+    // DC::construction with the k-means restarts drawn from rng::Engine(seed).
+    Solution dc(Instance const &I, unsigned seed);
+
+    size_t size() const;
+    void clear();
+
+private:
+    // Instance name, n, nK, C, gamma, constructor, then its parameters.
+    using Key = std::tuple<std::string, int, int, int, int, std::string, double, int>;
+
+    Solution get_or_build(Key const &key, std::function<Solution()> const &build);
+
+    mutable std::mutex mutex;
+    std::map<Key, std::shared_future<Solution>> entries;
+};
@@ -46,7 +46,7 @@ public:
     virtual ~Neighborhood() = default;
 
     virtual std::vector<GenericMove> generate() const = 0;
-    virtual std::optional<GenericMove> generate_random(std::mt19937 &rng) const = 0;
+    virtual std::optional<GenericMove> generate_random(rng::Engine &rng) const = 0;
     virtual bool is_valid(const GenericMove &mov) const = 0;
     virtual double calc_delta(const GenericMove &mov) const = 0;
     virtual double calc_delta_jain(const GenericMove &mov) const = 0;
@@ -63,7 +63,7 @@ public:
     IntraRouteNeighborhood(const Instance &I_, const Solution &sol_)
     : Neighborhood(I_, sol_) {}
     std::vector<GenericMove> generate() const override;
-    std::optional<GenericMove> generate_random(std::mt19937 &rng) const;
+    std::optional<GenericMove> generate_random(rng::Engine &rng) const;
     bool is_valid(const GenericMove &mov) const override;
     double calc_delta(const GenericMove &mov) const override;
     double calc_delta_jain(const GenericMove &mov) const override;
@@ -85,7 +85,7 @@ public:
 //     PairRelocateNeighborhood(const Instance &I_, const Solution &sol_)
 //     : Neighborhood(I_, sol_) {}
 //     std::vector<GenericMove> generate() const override;
-//     std::optional<GenericMove> generate_random(std::mt19937 &rng) const;
+//     std::optional<GenericMove> generate_random(rng::Engine &rng) const;
 //     bool is_valid(const GenericMove &mov) const override;
 //     double calc_delta(const GenericMove &mov) const override;
 //     Solution apply(const GenericMove &mov) const override;
@@ -106,7 +106,7 @@ class RequestMove : public Neighborhood
     RequestMove(const Instance &I_, const Solution &sol_)
     : Neighborhood(I_, sol_) {}
     std::vector<GenericMove> generate() const override;
-    std::optional<GenericMove> generate_random(std::mt19937 &rng) const;
+    std::optional<GenericMove> generate_random(rng::Engine &rng) const;
     bool is_valid(const GenericMove &mov) const override;
     double calc_delta(const GenericMove &mov) const override;
     double calc_delta_jain(const GenericMove &mov) const override;
@@ -128,7 +128,7 @@ class TwoOptNeighborhood : public Neighborhood
     TwoOptNeighborhood(const Instance &I_, const Solution &sol_)
     : Neighborhood(I_, sol_) {}
     std::vector<GenericMove> generate() const override;
-    std::optional<GenericMove> generate_random(std::mt19937 &rng) const;
+    std::optional<GenericMove> generate_random(rng::Engine &rng) const;
     bool is_valid(const GenericMove &mov) const override;
     double calc_delta(const GenericMove &mov) const override;
     double calc_delta_jain(const GenericMove &mov) const override;
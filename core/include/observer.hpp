@@ -0,0 +1,85 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "structures.hpp"
+
+struct Incumbent
+{
+    double objective;
+    double elapsed_ms; // since the solver started
+    size_t iteration;
+};
+
+/**
+ * Anytime callback. Every solver calls on_incumbent each time it finds a new best solution,
+ * so it is called from the solver's hot loop and has to be cheap.
+ */
+class IncumbentObserver
+{
+public:
+    virtual ~IncumbentObserver() = default;
+    virtual void on_incumbent(Incumbent const &incumbent, Solution const &sol) = 0;
+};
+
+// Used by the solvers to timestamp their incumbents.
+class RunClock
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+public:
+    inline double elapsed_ms() const
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+};
+
+inline void notify_incumbent(IncumbentObserver *observer, RunClock const &clock, size_t iteration, double objective, Solution const &sol)
+{
+    if (observer)
+        observer->on_incumbent(Incumbent{objective, clock.elapsed_ms(), iteration}, sol);
+}
+
+/**
+ * Streams incumbents to a csv file (elapsed_ms,iteration,objective) while the solver runs.
+ * Solver threads push into a bounded lock-free ring and never block; a background thread
+ * drains it every flush_ms. If the ring is full the record is dropped and counted.
+ */
+class IncumbentStream : public IncumbentObserver
+{
+    struct Slot
+    {
+        std::atomic<size_t> seq;
+        Incumbent incumbent;
+    };
+
+    std::vector<Slot> ring;
+    size_t mask;
+    std::atomic<size_t> head{0}; // producers
+    size_t tail = 0;             // consumer thread only
+    std::atomic<size_t> dropped{0};
+
+    std::ofstream out;
+    int flush_ms;
+    bool running = true;
+    std::mutex wake_mutex;
+    std::condition_variable wake;
+    std::thread writer;
+
+    void drain();
+    void run();
+
+public:
+    explicit IncumbentStream(std::string const &path, size_t capacity = 1024, int flush_ms = 100);
+    ~IncumbentStream();
+    IncumbentStream(IncumbentStream const &) = delete;
+    IncumbentStream &operator=(IncumbentStream const &) = delete;
+
+    void on_incumbent(Incumbent const &incumbent, Solution const &sol) override;
+    size_t num_dropped() const;
+};
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+
+/**
+ * Counter-based random numbers. The n-th number of a stream is a pure function of the seed,
+ * the stream id and n (SplitMix64 over a per-stream key and increment), so a task that owns
+ * its stream draws the same numbers whichever thread runs it and whatever ran before. Streams
+ * cost two words: hand one to every task (island, restart, chain) instead of sharing an
+ * engine. Engine satisfies UniformRandomBitGenerator and works with the std distributions.
+ */
+namespace rng
+{
+    // One SplitMix64 step: golden ratio increment, then the finalizer.
+    constexpr uint64_t mix64(uint64_t x)
+    {
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+
+    class Engine
+    {
+    public:
+        using result_type = uint64_t;
+
+        Engine(uint64_t seed, uint64_t stream = 0)
+            : key(mix64(mix64(seed) ^ mix64(stream ^ 0x5851f42d4c957f2dULL))),
+              increment(mix64(key ^ 0xda942042e4dd58b5ULL) | 1) {}
+
+        result_type operator()() { return mix64(key + increment * counter++); }
+        static constexpr result_type min() { return 0; }
+        static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+        // Skips n numbers in O(1).
+        void discard(uint64_t n) { counter += n; }
+        // Independent child stream, e.g. one per island of a run that was given this engine.
+        Engine split(uint64_t substream) const { return Engine(key, substream); }
+
+    private:
+        uint64_t key;
+        uint64_t increment; // odd, per stream
+        uint64_t counter = 0;
+    };
+
+    // Process wide base seed, drawn from std::random_device until set_seed is called.
+    uint64_t seed();
+    void set_seed(uint64_t seed);
+
+    // Stream id of the base seed. The same id under the same seed gives the same numbers.
+    Engine stream(uint64_t id);
+
+    /**
+     * Engine of the calling thread, for callers that were not handed one. Threads get their
+     * streams in the order they first ask, so results only repeat if the threads do; solvers
+     * that need reproducible runs take an Engine. Recreated after set_seed.
+     */
+    Engine &thread_engine();
+};
@@ -0,0 +1,81 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "structures.hpp"
+
+/**
+ * Process wide memo of create_track_route. Routes are keyed by a 128 bit hash of the request
+ * set (order does not matter), the beam width and the instance, so encodings, LN and GA that
+ * ask for the same set again pay one hash lookup. Sharded LRU, safe to use from many threads.
+ */
+class RouteCache
+{
+public:
+    struct Key
+    {
+        uint64_t lo;
+        uint64_t hi;
+        bool operator==(Key const &other) const { return lo == other.lo && hi == other.hi; }
+    };
+
+    struct Entry
+    {
+        std::vector<int> route;
+        double distance;
+    };
+
+    struct Stats
+    {
+        size_t hits;
+        size_t misses;
+        size_t evictions;
+        size_t size;
+    };
+
+    static RouteCache &global();
+
+    explicit RouteCache(size_t capacity = 1 << 16);
+
+    static Key make_key(Instance const &I, int beam_width, std::vector<int> const &requests);
+    bool lookup(Key const &key, Entry &out);
+    void insert(Key const &key, Entry entry);
+
+    void clear();
+    void set_capacity(size_t capacity);
+    Stats stats() const;
+    void reset_stats();
+
+private:
+    static constexpr size_t NUM_SHARDS = 16;
+
+    struct KeyHash
+    {
+        size_t operator()(Key const &k) const { return (size_t)(k.lo ^ (k.hi * 0x9e3779b97f4a7c15ULL)); }
+    };
+
+    struct Shard
+    {
+        mutable std::mutex mutex;
+        std::list<std::pair<Key, Entry>> lru; // most recent first
+        std::unordered_map<Key, std::list<std::pair<Key, Entry>>::iterator, KeyHash> index;
+    };
+
+    std::array<Shard, NUM_SHARDS> shards;
+    std::atomic<size_t> capacity_per_shard;
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> evictions{0};
+
+    Shard &shard_of(Key const &key) { return shards[key.hi % NUM_SHARDS]; }
+};
+
+/**
+ * create_track_route through RouteCache::global(). Returns the route and its distance.
+ * Routes built after cancel tripped are returned but not cached.
+ */
+RouteCache::Entry cached_track_route(Instance const &I, int beam_width, std::vector<int> const &requests, CancellationToken const *cancel = nullptr);
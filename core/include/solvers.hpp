@@ -1,37 +1,51 @@
 #pragma once
+#include <stdexcept>
 #include <vector>
 #include "structures.hpp"
 #include "neighborhoods.hpp"
 #include "step_function.hpp"
 #include "stopping_criteria.hpp"
+#include "observer.hpp"
+#include "route_cache.hpp"
 
 namespace DC // Deterministic Construction
 {
 
+    // The k-means restarts draw from gen. With a seeded engine the result is reproducible.
     Solution construction(
-        const Instance &I);
+        const Instance &I, rng::Engine *gen = nullptr);
 };
 namespace RC // Random Construction
 {
     Solution construction(
         const Instance &I,
-        double lamda);
+        double lamda,
+        rng::Engine *engine = nullptr);
 };
 
 namespace BS
 {
+    // Compact beam state. The route is not stored, it is reconstructed from the parent
+    // pointers of the winning state. Active/remaining sets are bitsets kept next to the beam.
     struct BeamState
     {
+        int node;   // last visited node
+        int parent; // index of the previous state in the arena, -1 for the depot
         int cargo;
         double score;
-        std::vector<int> route;
-        std::vector<int> active;
-        std::vector<int> remaining;
     };
 
     Solution beam_search(const Instance &I, double a, int beam_width = 5);
 
 };
+
+/**
+ * Builds a single route for the given requests with beam search. If cancel trips during
+ * the search the beam collapses to its best state which is then completed greedily, so the
+ * returned route is always complete.
+ */
+std::vector<int> create_track_route(Instance const &I, int beam_width, std::vector<int> const &requests, CancellationToken const *cancel = nullptr);
+
 namespace LS
 {
     Solution local_search(
@@ -40,7 +54,9 @@ namespace LS
         const Neighborhood::NeighborhoodFactory &neigh_factories,
         StepFunction::Func step_function,
         StoppingCriterion &criterion,
-        int *iteration_ptr = nullptr);
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
 };
 
 namespace VND
@@ -52,16 +68,33 @@ namespace VND
         const Neighborhood::NeighborhoodFactories &neighborhood_factories,
         StepFunction::Func step_function,
         StoppingCriterion &stopping_criterion,
-        int *iteration_ptr = nullptr);
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
 
 };
 namespace GRASP // Replace with the real randomized constructor
 {
+    // Thrown by a randomized constructor that cannot serve gamma requests. grasp and
+    // parallel_grasp skip the restart.
+    struct ConstructionFailed : std::runtime_error
+    {
+        using std::runtime_error::runtime_error;
+    };
 
+    /**
+     * Requests are drawn from the alpha fraction of the cheapest ones left (utils::calc_my_metric
+     * with a) and inserted into the first vehicle, in random order, with room for them. The
+     * insertion positions are drawn among the feasible ones: uniformly, or with temperature > 0
+     * in proportion to exp(-added distance / temperature). Throws ConstructionFailed if fewer
+     * than gamma requests fit.
+     */
     Solution randomized_constructor_simple(
         const Instance &I,
         double a,
-        double alpha);
+        double alpha,
+        double temperature = 0.0,
+        rng::Engine *engine = nullptr);
 
     Solution grasp(
         const Instance &I,
@@ -70,7 +103,31 @@ namespace GRASP // Replace with the real randomized constructor
         StepFunction::Func step_function,
         StoppingCriterion &stopping_outer,
         StoppingCriterion &stopping_local,
-        int *iteration_ptr = nullptr);
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
+
+    /**
+     * grasp with the restarts run in parallel on ThreadPool::global(). Restart r constructs
+     * and searches with its own stream split from engine and its own criterion from
+     * make_stopping_local, so seeded runs repeat on any number of threads. The best objective
+     * is an atomic that restarts read without locking; the best solution is behind a mutex,
+     * which also guards stopping_outer (asked before every restart).
+     * @param abort_margin A local search this much (relative) worse than the best restart of
+     *        its neighborhood was after as many iterations is abandoned. Infinity keeps every
+     *        restart, and the result then does not depend on timing.
+     */
+    Solution parallel_grasp(
+        const Instance &I,
+        std::function<Solution(const Instance &, rng::Engine &)> randomized_constructor,
+        const Neighborhood::NeighborhoodFactories &neighborhoods,
+        StepFunction::Func step_function,
+        StoppingCriterion &stopping_outer,
+        std::function<std::shared_ptr<StoppingCriterion>()> make_stopping_local,
+        double abort_margin = std::numeric_limits<double>::infinity(),
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
 };
 
 namespace SA
@@ -84,7 +141,71 @@ namespace SA
         double cooling,
         StepFunction::Func step_function,
         StoppingCriterion &stopping_criterion,
-        int *iteration_ptr = nullptr);
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
+
+    /**
+     * Same schedule on an AnnealingState: swap, 2-opt and request relocation moves applied in
+     * place with incrementally kept objective, no per-iteration allocation or solution copy.
+     * Use this one unless custom neighborhoods are needed.
+     * Once almost every move is rejected, proposals are evaluated in batches of up to 1024
+     * steps and the stopping criterion is checked once per batch. Batches are capped by
+     * StoppingCriterion::iterations_left, so MaxIterations is met exactly; a time or
+     * improvement based criterion may stop up to one batch late. Each batch runs on
+     * ThreadPool::global() or on the calling thread, whichever advanced the chain faster when
+     * last timed; the chain is the same either way. Speedups were only measured on one core,
+     * where the pool did not win.
+     */
+    Solution simulated_annealing(
+        const Instance &I,
+        const Solution &initial_sol,
+        double T_start,
+        double T_end,
+        double cooling,
+        StoppingCriterion &stopping_criterion,
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
+
+    struct TemperingParams
+    {
+        int replicas = 0;          // 0 = one per thread of ThreadPool::global(), at least 2
+        double T_min = 0.0;        // 0 = calibrated on the initial solution
+        double T_max = 0.0;        // 0 = calibrated on the initial solution
+        int swap_interval = 1000;  // steps of every replica between exchange attempts
+    };
+
+    struct ReplicaReport
+    {
+        double temperature = 0.0;
+        size_t iterations = 0;
+        size_t accepted = 0;
+        size_t swaps_attempted = 0; // with the next hotter replica
+        size_t swaps_accepted = 0;
+        double best_objective = 0.0; // best found at this temperature
+    };
+
+    /**
+     * Replica exchange annealing: one AnnealingChain per temperature of a geometric ladder
+     * T_min..T_max, stepped in parallel at a fixed temperature. Every swap_interval steps
+     * neighbouring temperatures (even pairs, then odd pairs) exchange their chains with the
+     * Metropolis rule, so good solutions drift to the cold end while hot chains keep exploring.
+     * Without T_max the ladder is set from the uphill moves of the initial solution: T_max
+     * accepts the average one with probability 1/2, and T_min defaults to T_max / 1000.
+     * Each replica draws from its own stream split from engine, so a seeded run repeats on
+     * any number of threads. The stopping criterion sees the steps per replica.
+     * @param reports If not nullptr it is filled with one entry per temperature, coldest first
+     */
+    Solution parallel_tempering(
+        const Instance &I,
+        const Solution &initial_sol,
+        TemperingParams const &params,
+        StoppingCriterion &stopping_criterion,
+        int *iteration_ptr = nullptr,
+        IncumbentObserver *observer = nullptr,
+        std::vector<ReplicaReport> *reports = nullptr,
+        rng::Engine *engine = nullptr); // nullptr = rng::thread_engine()
 };
 
 namespace LN
@@ -123,14 +244,123 @@ namespace LN
         double delta;
         std::vector<int> rest_requests;
     };
-    RequestPair find_heaviest_request_in_route(Instance const &I, Encoding const &encoding, int vehicle, int beam_width);
-    RequestPair find_best_request_to_add(Instance const &I, Encoding const &encoding, int vehicle, int beam_width);
+    // With rescore <= 0 (the default) every candidate is evaluated with beam search, as in the
+    // _exact versions. With rescore > 0 candidates are estimated by repairing the current route
+    // (pair removal / cheapest pair insertion) and beam search runs only for the `rescore` best
+    // estimates; the returned delta is the beam search one. Insertion first screens the non
+    // delivered requests by their distance to the centroid of the route, keeping
+    // screen_per_rescore * rescore of them for the estimate.
+    RequestPair find_heaviest_request_in_route(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel = nullptr, int rescore = 0);
+    RequestPair find_best_request_to_add(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel = nullptr, int rescore = 0, int screen_per_rescore = 8);
+    // Reference versions with one beam search per candidate.
+    RequestPair find_heaviest_request_in_route_exact(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel = nullptr);
+    RequestPair find_best_request_to_add_exact(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel = nullptr);
     Encoding apply_removal(Instance const &I, Encoding const &encoding, std::vector<RequestPair> const &to_be_removed);
     Encoding apply_addition(Instance const &I, Encoding const &encoding, std::vector<RequestPair> const &to_be_removed);
-    Encoding remove_requests(Instance const &I, Encoding const &encoding, int k, int beam_width);
-    Encoding append_requests(Instance const &I, Encoding const &encoding, int k, int beam_width);
-    Solution large_neighborhood(Instance const &I, Solution const &sol, int k, size_t iters, int bw_remove, int bw_append, std::vector<double>* objectives_over_time = nullptr);
+    Encoding remove_requests(Instance const &I, Encoding const &encoding, int k, int beam_width, CancellationToken const *cancel = nullptr, int rescore = 0);
+    Encoding append_requests(Instance const &I, Encoding const &encoding, int k, int beam_width, CancellationToken const *cancel = nullptr, int rescore = 0, int screen_per_rescore = 8);
+    // Stops after the current iteration once cancel trips and returns the best solution so far.
+    // rescore > 0 evaluates only that many candidates per vehicle with beam search, see above.
+    Solution large_neighborhood(Instance const &I, Solution const &sol, int k, size_t iters, int bw_remove, int bw_append, std::vector<double>* objectives_over_time = nullptr, CancellationToken const *cancel = nullptr, IncumbentObserver *observer = nullptr, int rescore = 0, int screen_per_rescore = 8);
+
+    // Counters of the candidate filtering above (rescore > 0 only), over all threads since the
+    // last reset.
+    struct ScreeningCounts
+    {
+        size_t candidates; // considered at all
+        size_t estimated;  // estimated by route repair
+        size_t exact;      // evaluated with beam search
+        size_t skipped;    // candidates - exact
+    };
+    struct ScreeningStats
+    {
+        ScreeningCounts removal;   // find_heaviest_request_in_route
+        ScreeningCounts insertion; // find_best_request_to_add
+    };
+    ScreeningStats screening_stats();
+    void reset_screening_stats();
+
+};
+
+namespace REGRET // Regret-k insertion
+{
+    /**
+     * Inserts up to to_add of the requests not in routes, the one with the largest regret (sum
+     * over j < k of the j-th cheapest minus the cheapest vehicle insertion) first. Routes are
+     * updated in place. Insertion costs sit in a lazily updated priority queue, after each
+     * insertion only the row of the changed vehicle is recomputed. k = 1 is greedy insertion.
+     * Returns the pairs for LN::apply_addition, fewer than to_add if nothing fits anymore.
+     */
+    std::vector<LN::RequestPair> insert(Instance const &I, std::vector<std::vector<int>> &routes, int to_add, int k = 3);
+    // Adds requests to the decoded routes of encoding until gamma are served.
+    Encoding repair(Instance const &I, Encoding const &encoding, int k = 3, int beam_width = 5, CancellationToken const *cancel = nullptr);
+    // Starts from empty routes and inserts gamma requests.
+    Solution construction(Instance const &I, int k = 3);
+};
+
+namespace ALNS
+{
+    // Adaptive large neighborhood search over encodings. Every iteration picks a destroy and a
+    // repair operator by roulette wheel, removes q requests and inserts requests back until
+    // gamma is served, then accepts the decoded solution with a simulated annealing rule.
+    enum class Destroy
+    {
+        RANDOM,
+        WORST, // largest removal savings in the current routes
+        SHAW,  // requests close to each other (pickup to pickup plus delivery to delivery)
+        ROUTE  // all requests of one vehicle
+    };
+    enum class Repair
+    {
+        GREEDY, // cheapest insertion over all vehicles
+        REGRET  // largest regret-k over the vehicles first
+    };
+
+    struct Params
+    {
+        int min_remove = 4;
+        int max_remove = 30;
+        int beam_width = 5;
+        int regret_k = 3;
+        double randomness = 4.0;   // p of the y^p rank selection in WORST and SHAW, larger is greedier
+        double start_worse = 0.02; // a solution that much worse than the initial one is accepted with 0.5 at the start
+        double end_ratio = 0.002;  // T_end / T_start
+        double reaction = 0.2;     // how fast the weights follow the segment scores
+        int segment = 25;          // iterations between weight updates
+        double sigma_best = 33.0;
+        double sigma_better = 9.0;
+        double sigma_accepted = 13.0;
+        double time_limit_ms = 0.0; // 0 = only iters. Also drives the temperature when set.
+    };
+
+    struct OperatorStats
+    {
+        std::string name;
+        size_t calls;
+        size_t new_best;
+        size_t improved; // better than the current solution
+        size_t accepted;
+        double total_ms;
+        double weight;
+    };
+
+    // Destroy operators return the pairs for LN::apply_removal (delta is the removal estimate).
+    std::vector<LN::RequestPair> destroy(Instance const &I, Solution const &sol, Destroy op, int q, double randomness, rng::Engine &rng);
 
+    // REGRET::insert with k = 1 for GREEDY and regret_k for REGRET.
+    std::vector<LN::RequestPair> repair(Instance const &I, std::vector<std::vector<int>> &routes, Repair op, int to_add, int regret_k);
+
+    /**
+     * @param iters Maximum number of destroy/repair iterations
+     * @param params See Params. params.time_limit_ms bounds the wall clock time
+     * @param objectives_over_time If not nullptr then it appends the best objective till that iteration
+     * @param cancel If not nullptr the run stops after the current iteration once it trips
+     * @param observer If not nullptr it is called on every new best solution
+     * @param stats If not nullptr it is filled with one entry per destroy and then per repair operator
+     * @param engine Random stream of the run. nullptr = rng::thread_engine(). The operator
+     * weights depend on measured run times, so a seeded run repeats only up to timing.
+     */
+    Solution alns(Instance const &I, Solution const &sol, size_t iters, Params const &params = {}, std::vector<double> *objectives_over_time = nullptr, CancellationToken const *cancel = nullptr, IncumbentObserver *observer = nullptr, std::vector<OperatorStats> *stats = nullptr, rng::Engine *engine = nullptr);
 };
 
 namespace GA
@@ -140,14 +370,26 @@ namespace GA
         double objective;
         Solution sol;
     };
-    BestSolution get_best_solution(Instance const &I, std::vector<Encoding> const &encodings, int beam_width);
+    BestSolution get_best_solution(Instance const &I, std::vector<Encoding> const &encodings, int beam_width, CancellationToken const *cancel = nullptr);
+    // Same, with objectives[i] the objective of encodings[i] as given by evaluate_population.
+    // objectives only picks the best encoding; the returned objective is that of the returned
+    // solution, which can differ if the evaluation was cancelled.
+    BestSolution get_best_solution(Instance const &I, std::vector<Encoding> const &encodings, std::vector<double> const &objectives, int beam_width, CancellationToken const *cancel = nullptr);
+    // Objective of every encoding, decoded in parallel on ThreadPool::global().
+    std::vector<double> evaluate_population(Instance const &I, std::vector<Encoding> const &population, int beam_width, CancellationToken const *cancel = nullptr);
     std::vector<Encoding> generate_initial_population(Instance const &I, int k1);
-    std::vector<Encoding> reproduce(Instance const &I, std::vector<Encoding> const &parents);
+    std::vector<Encoding> reproduce(Instance const &I, std::vector<Encoding> const &parents, rng::Engine *engine = nullptr);
     // If a combination results in a request being delivered by  strictly two vehicles this function resolves that.
     // It uses a uniform distribution.
     // It is meant to be used only inside the plus operator
-    std::vector<int> select_indices_next_generation(Instance const &I, std::vector<Encoding> const &population, int k1, int beam_width);
+    std::vector<int> select_indices_next_generation(Instance const &I, std::vector<Encoding> const &population, int k1, int beam_width, CancellationToken const *cancel = nullptr);
+    // Indices of the k1 smallest objectives, best first.
+    std::vector<int> select_indices_next_generation(std::vector<double> const &objectives, int k1);
     void mutate(Instance const &I, std::vector<Encoding> &population, int k2);
+    void mutate(Instance const &I, std::vector<Encoding> &population, int k2, rng::Engine &gen);
+    // Crosses all pairs of population, mutates the offspring and keeps the k1 best of them.
+    // population and objectives are replaced by the survivors, best first.
+    void next_generation(Instance const &I, std::vector<Encoding> &population, std::vector<double> &objectives, int k1, int k2, int beam_width, rng::Engine &rng, CancellationToken const *cancel = nullptr);
 
     /**
      * @param k1 Number of population to be reproduced
@@ -155,7 +397,52 @@ namespace GA
      * @param iters Number of iterations-generations
      * @param beam_width Beam width of the beam search used to create the route
      * @param objectives_over_time If not nullptr then it appends the best objective till that iteration
+     * @param cancel If not nullptr the run stops after the current generation once it trips
+     * @param observer If not nullptr it is called on every new best solution
+     * @param engine Random stream of the run. nullptr = rng::thread_engine()
      */
-    Solution genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, std::vector<double>* objectives_over_time = nullptr);
+    Solution genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, std::vector<double>* objectives_over_time = nullptr, CancellationToken const *cancel = nullptr, IncumbentObserver *observer = nullptr, rng::Engine *engine = nullptr);
     //  Solution genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width);
+
+    struct IslandParams
+    {
+        int islands = 0;             // 0 = one per thread of ThreadPool::global()
+        int migration_interval = 10; // generations between migrations
+        int migrants = 2;            // best encodings sent to the next island on the ring
+    };
+
+    struct IslandReport
+    {
+        int island = 0;
+        size_t generations = 0;
+        size_t immigrants_accepted = 0;
+        double best_objective = 0.0;
+        std::vector<double> best_over_time; // best objective of the island after each generation
+    };
+
+    /**
+     * genetic_algorithm on several populations that evolve in parallel, each with its own
+     * random stream split from engine. Islands never wait for each other: every
+     * migration_interval generations an island posts its best migrants to the next island on
+     * a ring through a lock-free single-slot mailbox, and replaces its worst encodings with
+     * the better of the migrants its predecessor posted last. Which migrants arrive depends on
+     * timing, so seeded runs repeat only without migration (migrants 0 or one island). Islands
+     * beyond the number of threads start only when another one finishes, so use at most one
+     * island per thread.
+     * @param objectives_over_time If not nullptr then it appends the best objective over all islands per generation
+     * @param reports If not nullptr it is filled with one entry per island
+     * Other parameters as in genetic_algorithm.
+     */
+    Solution island_genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, IslandParams const &params = {}, std::vector<double> *objectives_over_time = nullptr, CancellationToken const *cancel = nullptr, IncumbentObserver *observer = nullptr, std::vector<IslandReport> *reports = nullptr, rng::Engine *engine = nullptr);
+
+    /**
+     * Steady state variant of genetic_algorithm. Every generation creates offspring children
+     * from parents chosen by tournaments of size tournament, mutates them with k2 mutations
+     * and lets each replace the worst member of the population if it is better. Children whose
+     * Encoding::hash is already in the population are dropped before decoding, so a
+     * generation costs O(offspring) decodings however large k1 is.
+     * @param k1 Population size, at least 2
+     * Other parameters as in genetic_algorithm.
+     */
+    Solution steady_state_genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, int offspring, int tournament = 2, std::vector<double> *objectives_over_time = nullptr, CancellationToken const *cancel = nullptr, IncumbentObserver *observer = nullptr, rng::Engine *engine = nullptr);
 };
\ No newline at end of file
@@ -7,10 +7,10 @@
 namespace StepFunction
 {
     using Return_t = std::optional<GenericMove>;
-    using Func = std::function<Return_t(const Neighborhood &, std::mt19937 &)>;
+    using Func = std::function<Return_t(const Neighborhood &, rng::Engine &)>;
 
 
-    inline Return_t first_improvement(const Neighborhood &N, std::mt19937 &rng)
+    inline Return_t first_improvement(const Neighborhood &N, rng::Engine &rng)
     {
         const size_t _MAX_TRIES = 1000; // random tries before giving up
 
@@ -31,7 +31,7 @@ namespace StepFunction
         return std::nullopt;
     }
 
-    inline Return_t best_improvement(const Neighborhood &N, std::mt19937 &)
+    inline Return_t best_improvement(const Neighborhood &N, rng::Engine &)
     {
         std::vector<GenericMove> moves =  N.generate();
 
@@ -52,9 +52,8 @@ namespace StepFunction
         return best;
     }
 
-    inline Return_t random_step(const Neighborhood &N, std::mt19937 &rng)
+    inline Return_t random_step(const Neighborhood &N, rng::Engine &rng)
     {
-        // static thread_local std::mt19937 rng(std::random_device{}());
         return N.generate_random(rng);
     }
 
@@ -1,7 +1,57 @@
 #pragma once
+#include <algorithm>
 #include <cmath>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdint>
+#include <limits>
+
+/**
+ * Shared flag used for cooperative cancellation. Solvers poll it at safe points and
+ * return their best solution so far once it is set. A deadline can be attached so
+ * that the token trips by itself, which is how per-instance time limits are enforced
+ * for solvers that do not take a StoppingCriterion (LN, GA).
+ */
+class CancellationToken
+{
+    using clock = std::chrono::steady_clock;
+    static constexpr std::int64_t NO_DEADLINE = std::numeric_limits<std::int64_t>::max();
+
+    mutable std::atomic<bool> cancelled{false};
+    std::atomic<std::int64_t> deadline_ns{NO_DEADLINE};
+
+    static std::int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now().time_since_epoch()).count();
+    }
+
+public:
+    CancellationToken() = default;
+    CancellationToken(CancellationToken const &) = delete;
+    CancellationToken &operator=(CancellationToken const &) = delete;
+
+    inline void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+
+    // Token trips by itself ms milliseconds from now.
+    inline void cancel_after(double ms)
+    {
+        deadline_ns.store(now_ns() + (std::int64_t)(ms * 1e6), std::memory_order_relaxed);
+    }
+
+    inline bool is_cancelled() const
+    {
+        if (cancelled.load(std::memory_order_relaxed))
+            return true;
+        auto deadline = deadline_ns.load(std::memory_order_relaxed);
+        if (deadline == NO_DEADLINE || now_ns() < deadline)
+            return false;
+        cancelled.store(true, std::memory_order_relaxed);
+        return true;
+    }
+};
 
 class StoppingCriterion
 {
@@ -9,6 +59,9 @@ public:
     virtual ~StoppingCriterion() = default;
     virtual void reset() = 0;
     virtual bool operator()(int iteration, double f) = 0;
+    // Iterations after `iteration` the criterion stops at the latest, if that is known in
+    // advance. Lets solvers that check it once per batch of iterations size the last batch.
+    virtual int iterations_left(int) const { return std::numeric_limits<int>::max(); }
 };
 
 class MaxIterations : public StoppingCriterion
@@ -24,6 +77,10 @@ public:
     {
         return iteration >= max_iters;
     }
+    inline int iterations_left(int iteration) const override
+    {
+        return std::max(0, max_iters - iteration);
+    }
 };
 
 class ObjectiveThreshold : public StoppingCriterion
@@ -71,6 +128,92 @@ public:
     }
 };
 
+/**
+ * Wall-clock budget. The clock is only read every check_every calls, so the criterion
+ * is cheap enough for SA-like loops with millions of iterations. The budget starts at
+ * construction and is restarted by reset().
+ */
+class TimeBudget : public StoppingCriterion
+{
+    using clock = std::chrono::steady_clock;
+    double budget_ms;
+    int check_every;
+    int calls;
+    bool expired;
+    clock::time_point start;
+
+public:
+    explicit TimeBudget(double ms, int check_every = 16)
+        : budget_ms(ms), check_every(check_every > 0 ? check_every : 1), calls(0), expired(false), start(clock::now()) {}
+
+    inline void reset() override
+    {
+        calls = 0;
+        expired = false;
+        start = clock::now();
+    }
+
+    inline bool operator()(int, double) override
+    {
+        if (expired)
+            return true;
+        if (calls++ % check_every != 0)
+            return false;
+        expired = std::chrono::duration<double, std::milli>(clock::now() - start).count() >= budget_ms;
+        return expired;
+    }
+};
+
+/**
+ * Same as TimeBudget but measures the CPU time of the whole process (std::clock).
+ * With several worker threads the budget is consumed proportionally faster.
+ */
+class CpuTimeBudget : public StoppingCriterion
+{
+    double budget_ms;
+    int check_every;
+    int calls;
+    bool expired;
+    std::clock_t start;
+
+public:
+    explicit CpuTimeBudget(double ms, int check_every = 16)
+        : budget_ms(ms), check_every(check_every > 0 ? check_every : 1), calls(0), expired(false), start(std::clock()) {}
+
+    inline void reset() override
+    {
+        calls = 0;
+        expired = false;
+        start = std::clock();
+    }
+
+    inline bool operator()(int, double) override
+    {
+        if (expired)
+            return true;
+        if (calls++ % check_every != 0)
+            return false;
+        expired = 1000.0 * (double)(std::clock() - start) / CLOCKS_PER_SEC >= budget_ms;
+        return expired;
+    }
+};
+
+// Adapter so that LS, VND, SA and GRASP stop on a shared CancellationToken.
+class Cancelled : public StoppingCriterion
+{
+    CancellationToken const &token;
+
+public:
+    explicit Cancelled(CancellationToken const &t)
+        : token(t) {}
+
+    inline void reset() override {}
+    inline bool operator()(int, double) override
+    {
+        return token.is_cancelled();
+    }
+};
+
 // MAYBE COMBO OF CRITERIA
 // -----------------------
 
@@ -96,6 +239,14 @@ public:
                 return true;
         return false;
     }
+
+    int iterations_left(int iteration) const override
+    {
+        int left = std::numeric_limits<int>::max();
+        for (auto const &c : criteria)
+            left = std::min(left, c->iterations_left(iteration));
+        return left;
+    }
 };
 
 class AllCriterion : public StoppingCriterion
@@ -119,4 +270,12 @@ public:
                 return false;
         return true;
     }
+
+    int iterations_left(int iteration) const override
+    {
+        int left = 0;
+        for (auto const &c : criteria)
+            left = std::max(left, c->iterations_left(iteration));
+        return left;
+    }
 };
\ No newline at end of file
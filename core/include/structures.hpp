@@ -6,6 +6,11 @@
 #include <functional>
 #include <optional>
 #include <memory>
+#include <mutex>
+#include <cstdint>
+#include "rng.hpp"
+
+class CancellationToken;
 
 namespace gt // GeneralTypes
 {
@@ -60,39 +65,125 @@ struct Solution
     void compute_cached_values_from_routes(Instance const &I);
 };
 
+/**
+ * shared_ptr to an immutable value that const methods may publish from several threads at
+ * once. The lock only guards the pointer copy. Copies take a snapshot, so classes holding one
+ * stay copyable.
+ */
+template <typename T>
+class SharedSlot
+{
+    mutable std::mutex mutex;
+    mutable std::shared_ptr<T const> value;
+
+public:
+    SharedSlot() = default;
+    SharedSlot(SharedSlot const &other) : value(other.load()) {}
+    SharedSlot &operator=(SharedSlot const &other)
+    {
+        store(other.load());
+        return *this;
+    }
+
+    std::shared_ptr<T const> load() const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return value;
+    }
+    void store(std::shared_ptr<T const> new_value) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        value.swap(new_value); // the old value is released after the lock
+    }
+    void reset() const { store(nullptr); }
+};
+
 class Encoding
 {
-    mutable std::optional<Solution> cached_solution = std::nullopt;
+    struct DecodedSolution
+    {
+        int beam_width;
+        Solution sol;
+    };
+    SharedSlot<DecodedSolution> cached_solution;
     using dna_t = std::vector<std::vector<bool>>;
-    // Check if you can use a single vector with offset
-    dna_t dna;
+    // Which vehicle delivers each request (-1 = none) and the same as one bitset per vehicle,
+    // num_words 64 bit words each, plus the union of those bitsets. All are kept in sync by
+    // the setters.
+    int num_vehicles = 0;
+    int num_requests = 0;
+    int num_words = 0;
+    int served = 0;
+    std::vector<int16_t> vehicle_of_request;
+    std::vector<uint64_t> bits;
+    std::vector<uint64_t> served_bits;
+
+    // Decoded route per vehicle, nullptr while the vehicle is dirty. Shared with the encodings
+    // this one was derived from, so to_sol only rebuilds the vehicles that changed. Concurrent
+    // to_sol calls may build the same route twice, either result is kept.
+    struct DecodedRoute
+    {
+        std::vector<int> route;
+        double distance;
+        int beam_width;
+    };
+    std::vector<SharedSlot<DecodedRoute>> decoded_routes;
+
     // Used inside to_sol.
-    Solution _compute_solution(Instance const& I, int beam_width = 5) const ;
+    Solution _compute_solution(Instance const& I, int beam_width = 5, CancellationToken const *cancel = nullptr) const ;
+    // Takes the decoded routes of parent for the vehicles whose requests are the same.
+    void inherit_routes(Encoding const &parent);
+    // Offspring delivering request r with the vehicle of this if take_this has bit r, with the
+    // vehicle of other if take_other has it. The two masks must not overlap.
+    Encoding blend(Encoding const &other, std::vector<uint64_t> const &take_this, std::vector<uint64_t> const &take_other) const;
+
+    static uint64_t bit_of(int request) { return uint64_t{1} << (request % 64); }
+    uint64_t &word_of(int vehicle, int request) { return bits[(size_t)vehicle * num_words + request / 64]; }
 
 public:
     Encoding() = default;
+    // Nothing delivered.
+    Encoding(int num_vehicles, int num_requests);
     Encoding(dna_t &&dna);
     Encoding(Instance const &I, Solution const &sol);
 
 
     bool is_encoding_correct(Instance const &I) const;
+    // Uniform crossover. operator+ draws from rng::thread_engine().
     Encoding operator+(Encoding const &other) const;
-    Encoding add(Instance const &I, Encoding const &other) const;
+    Encoding uniform_crossover(Encoding const &other, rng::Engine &engine) const;
+    // engine nullptr = rng::thread_engine()
+    Encoding add(Instance const &I, Encoding const &other, rng::Engine *engine = nullptr) const;
     
     /**
      * Uses beam search for each route seperately to create a route.
      * See create_track_route in beam search. 
      * Uses memoization and caches solution. If then encoding is passed over functions
      * one can save time from omiting call (_compute_solution)
+     * A decoding interrupted by cancel is returned but not cached. The cache is per beam width:
+     * asking for another width decodes again (unchanged routes of that width are reused).
+     * Safe to call from several threads on the same encoding. The setters are not and need
+     * the encoding for themselves.
      */
-    Solution to_sol(Instance const& I, int beam_width = 5) const ;
-    int total_num_of_requests() const;
+    Solution to_sol(Instance const& I, int beam_width = 5, CancellationToken const *cancel = nullptr) const ;
+    int total_num_of_requests() const; // O(1)
+    // 64 bit hash of the request sets of the vehicles. Encodings that only differ in how the
+    // vehicles are numbered decode to the same solution and hash equal. O(nK * n / 64).
+    uint64_t hash() const;
+    // Moves the request to vehicle, or adds it if it was not delivered. O(1).
     void set_vehicle_for_request(int vehicle, int request);
+    // The request is not delivered anymore. O(1).
+    void unset_request(int request);
+    int get_vehicle_of_request(int request) const; // -1 if not delivered
+    bool is_served(int request) const;
     int get_num_vehicles() const;
     int get_num_requests() const;
-    std::vector<int> get_requests_of_route(int route) const;
+    // Vehicles that to_sol would have to decode again.
+    int num_dirty_routes() const;
+    std::vector<int> get_requests_of_route(int route) const; // O(n / 64 + result)
     std::vector<int> get_non_delivered_requests() const;
-    dna_t const& get_dna() const;
+    // nK x n matrix, built on every call.
+    dna_t get_dna() const;
     dna_t get_dna_copy() const;
 };
 
@@ -127,13 +218,43 @@ namespace utils
     std::vector<double> calc_my_metric(const Instance &I, double a);
 } // namespace utils
 
+namespace insertion
+{
+    // Pickup goes before position ip and delivery before position jp of the original route,
+    // 0 <= ip <= jp <= route.size(). delta is infinity if no feasible pair exists.
+    struct PairInsertion
+    {
+        double delta;
+        int ip;
+        int jp;
+    };
+
+    /**
+     * Cheapest capacity feasible insertion of request into route. cargo is calc_route_cargo
+     * of the route, so it can be reused for many requests. O(route.size()).
+     */
+    PairInsertion cheapest_pair_insertion(
+        Instance const &I, std::vector<int> const &route, std::vector<int> const &cargo, int request);
+    // Same with edges = route_edges(route) precomputed as well.
+    PairInsertion cheapest_pair_insertion(
+        Instance const &I, std::vector<int> const &route, std::vector<int> const &cargo,
+        std::vector<double> const &edges, int request);
+    // Length of the edges of the route including the two depot ones, size route.size() + 1.
+    std::vector<double> route_edges(Instance const &I, std::vector<int> const &route);
+
+    void apply_pair_insertion(Instance const &I, std::vector<int> &route, int request, PairInsertion const &ins);
+
+    // Distance change of deleting the nodes at p_idx < d_idx. Removal keeps a route feasible.
+    double pair_removal_delta(Instance const &I, std::vector<int> const &route, int p_idx, int d_idx);
+};
+
 namespace numerical
 {
     template <typename T>
     std::vector<int> argsort(const std::vector<T> &org);
 
     template <typename T>
-    T select_uniformly(const std::vector<T> &org, std::mt19937 &rng);
+    T select_uniformly(const std::vector<T> &org, rng::Engine &rng);
 
     double calc_distance_between_nodes(gt::Coords const &p1, gt::Coords const &p2);
 
@@ -149,6 +270,8 @@ namespace clusters
         centers_t centers;
 
         ClusterCenters(const Instance &I, std::vector<int> const &reqs);
+        // Initial centers drawn with gen instead of rng::thread_engine().
+        ClusterCenters(const Instance &I, std::vector<int> const &reqs, rng::Engine &gen);
         // Update via an assignment. Calcs the point average of that clusters requests(pickup only!)
         void update_centers(const Instance &I, const std::vector<int> &reqs, const std::vector<int> &assign);
     };
@@ -163,5 +286,6 @@ namespace clusters
         const Instance &I,
         const std::vector<int> &reqs,
         int iters,
-        int restarts);
+        int restarts,
+        rng::Engine *gen = nullptr); // nullptr = rng::thread_engine()
 };
\ No newline at end of file
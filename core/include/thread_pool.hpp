@@ -0,0 +1,112 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Fixed set of worker threads shared by the solvers. The only entry point is parallel_for:
+ * the calling thread takes part in the loop, so nested parallel_for calls (e.g. per vehicle,
+ * then per candidate) never wait on a queue that only they could drain. With no workers, as
+ * on a single core, parallel_for is a plain loop.
+ */
+class ThreadPool
+{
+public:
+    static ThreadPool &global();
+
+    // Workers besides the calling thread. Defaults to hardware_concurrency() - 1.
+    explicit ThreadPool(size_t num_workers = default_num_workers());
+    ~ThreadPool();
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    size_t num_workers() const { return workers.size(); }
+    static size_t default_num_workers();
+
+    /**
+     * Calls body(i) for every i in [0, n) and returns once all calls finished. Indices are
+     * claimed dynamically, so callers that need a deterministic result write to slot i of a
+     * preallocated vector. The first exception thrown by body is rethrown here; indices not
+     * started yet are skipped after it.
+     */
+    template <typename F>
+    void parallel_for(size_t n, F &&body);
+
+private:
+    struct Loop
+    {
+        size_t n;
+        std::function<void(size_t)> body;
+        std::atomic<size_t> next{0};
+        std::atomic<size_t> finished{0};
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+        std::mutex mutex;
+        std::condition_variable done;
+    };
+
+    static void run_loop(Loop &loop);
+    void submit(std::function<void()> task);
+    void work();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex mutex;
+    std::condition_variable wake;
+    bool stopping = false;
+};
+
+template <typename F>
+void ThreadPool::parallel_for(size_t n, F &&body)
+{
+    if (n == 0)
+        return;
+    if (workers.empty() || n == 1)
+    {
+        for (size_t i = 0; i < n; i++)
+            body(i);
+        return;
+    }
+
+    // Helpers may be dequeued after the loop finished, so they share ownership of it.
+    auto loop = std::make_shared<Loop>();
+    loop->n = n;
+    loop->body = std::ref(body);
+
+    size_t helpers = std::min(n - 1, workers.size());
+    for (size_t h = 0; h < helpers; h++)
+        submit([loop]
+               { run_loop(*loop); });
+
+    run_loop(*loop);
+
+    // Only indices already claimed by running threads remain, so this always returns.
+    {
+        std::unique_lock<std::mutex> lock(loop->mutex);
+        loop->done.wait(lock, [&]
+                        { return loop->finished.load(std::memory_order_acquire) == n; });
+    }
+    if (loop->error)
+        std::rethrow_exception(loop->error);
+}
+
+/**
+ * parallel_for on ThreadPool::global() collecting body(i) into slot i, so the result does not
+ * depend on scheduling.
+ */
+template <typename T, typename F>
+std::vector<T> parallel_map(size_t n, F &&body)
+{
+    std::vector<T> results(n);
+    ThreadPool::global().parallel_for(n, [&](size_t i)
+                                      { results[i] = body(i); });
+    return results;
+}
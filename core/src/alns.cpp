@@ -0,0 +1,320 @@
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <numeric>
+#include "solvers.hpp"
+#include "structures.hpp"
+
+namespace
+{
+    // Index into a list sorted best first. Larger randomness concentrates on the front.
+    size_t rank_select(size_t size, double randomness, rng::Engine &rng)
+    {
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        return std::min(size - 1, (size_t)(std::pow(uni(rng), randomness) * size));
+    }
+
+    struct ServedRequest
+    {
+        int request;
+        int vehicle;
+        int p_idx;
+        int d_idx;
+    };
+
+    std::vector<ServedRequest> served_requests(Instance const &I, Solution const &sol)
+    {
+        std::vector<ServedRequest> served;
+        std::vector<int> pickup_idx(I.n, -1);
+        for (int vehicle = 0; vehicle < (int)sol.routes.size(); vehicle++)
+        {
+            auto const &route = sol.routes[vehicle];
+            for (int idx = 0; idx < (int)route.size(); idx++)
+            {
+                int req = I.request_of_node[route[idx]];
+                if (route[idx] <= I.n) // pickup, whatever its demand
+                    pickup_idx[req] = idx;
+                else
+                    served.push_back(ServedRequest{req, vehicle, pickup_idx[req], idx});
+            }
+        }
+        return served;
+    }
+
+    double relatedness(Instance const &I, int a, int b)
+    {
+        return I.dist[1 + a][1 + b] + I.dist[1 + I.n + a][1 + I.n + b];
+    }
+
+    void remove_from_routes(Instance const &I, std::vector<std::vector<int>> &routes, std::vector<LN::RequestPair> const &removed)
+    {
+        std::vector<bool> is_removed(I.n, false);
+        for (auto const &pair : removed)
+            is_removed[pair.request_removed] = true;
+        for (auto &route : routes)
+            route.erase(std::remove_if(route.begin(), route.end(), [&](int node)
+                                       { return is_removed[I.request_of_node[node]]; }),
+                        route.end());
+    }
+
+    // Roulette wheel over operators with adaptive weights.
+    struct Portfolio
+    {
+        std::vector<ALNS::OperatorStats> stats;
+        std::vector<double> segment_score;
+        std::vector<size_t> segment_calls;
+        std::vector<double> segment_ms;
+
+        explicit Portfolio(std::vector<std::string> const &names)
+        {
+            for (auto const &name : names)
+                stats.push_back(ALNS::OperatorStats{name, 0, 0, 0, 0, 0.0, 1.0});
+            segment_score.assign(names.size(), 0.0);
+            segment_calls.assign(names.size(), 0);
+            segment_ms.assign(names.size(), 0.0);
+        }
+
+        int select(rng::Engine &rng) const
+        {
+            std::vector<double> weights;
+            for (auto const &op : stats)
+                weights.push_back(op.weight);
+            std::discrete_distribution<int> roulette(weights.begin(), weights.end());
+            return roulette(rng);
+        }
+
+        void record_time(int op, double ms)
+        {
+            stats[op].calls++;
+            stats[op].total_ms += ms;
+            segment_calls[op]++;
+            segment_ms[op] += ms;
+        }
+
+        void record_score(int op, double score, bool new_best, bool improved, bool accepted)
+        {
+            segment_score[op] += score;
+            stats[op].new_best += new_best;
+            stats[op].improved += improved;
+            stats[op].accepted += accepted;
+        }
+
+        // Score per call, divided by the time per call relative to the average operator, so a
+        // slow operator has to earn proportionally more to keep its weight.
+        void update_weights(double reaction)
+        {
+            double total_ms = 0.0;
+            size_t total_calls = 0;
+            for (size_t op = 0; op < stats.size(); op++)
+            {
+                total_ms += segment_ms[op];
+                total_calls += segment_calls[op];
+            }
+            double mean_ms = total_calls ? std::max(total_ms / total_calls, 1e-6) : 1.0;
+
+            for (size_t op = 0; op < stats.size(); op++)
+            {
+                if (segment_calls[op] == 0)
+                    continue;
+                double ms_per_call = std::max(segment_ms[op] / segment_calls[op], 1e-6);
+                double performance = (segment_score[op] / segment_calls[op]) / (ms_per_call / mean_ms);
+                stats[op].weight = std::max(0.05, (1.0 - reaction) * stats[op].weight + reaction * performance);
+            }
+            std::fill(segment_score.begin(), segment_score.end(), 0.0);
+            std::fill(segment_calls.begin(), segment_calls.end(), 0);
+            std::fill(segment_ms.begin(), segment_ms.end(), 0.0);
+        }
+    };
+
+    double elapsed_ms(std::chrono::steady_clock::time_point since)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+    }
+}
+
+std::vector<LN::RequestPair> ALNS::destroy(Instance const &I, Solution const &sol, Destroy op, int q, double randomness, rng::Engine &rng)
+{
+    auto served = served_requests(I, sol);
+    std::vector<LN::RequestPair> removed;
+    if (served.empty() || q <= 0)
+        return removed;
+    q = std::min<int>(q, served.size());
+
+    switch (op)
+    {
+    case Destroy::RANDOM:
+    {
+        std::shuffle(served.begin(), served.end(), rng);
+        for (int i = 0; i < q; i++)
+            removed.push_back(LN::RequestPair{served[i].request, served[i].vehicle, 0.0, {}});
+        break;
+    }
+    case Destroy::WORST:
+    {
+        // Savings are taken once from the current routes and not updated between removals.
+        std::vector<std::pair<double, ServedRequest>> ranked;
+        for (auto const &s : served)
+            ranked.emplace_back(insertion::pair_removal_delta(I, sol.routes[s.vehicle], s.p_idx, s.d_idx), s);
+        std::sort(ranked.begin(), ranked.end(), [](auto const &a, auto const &b)
+                  { return a.first < b.first; });
+        for (int i = 0; i < q; i++)
+        {
+            size_t pick = rank_select(ranked.size(), randomness, rng);
+            removed.push_back(LN::RequestPair{ranked[pick].second.request, ranked[pick].second.vehicle, ranked[pick].first, {}});
+            ranked.erase(ranked.begin() + pick);
+        }
+        break;
+    }
+    case Destroy::SHAW:
+    {
+        // Seed at random, then repeatedly take a request related to one already removed.
+        std::uniform_int_distribution<size_t> uni(0, served.size() - 1);
+        size_t seed = uni(rng);
+        removed.push_back(LN::RequestPair{served[seed].request, served[seed].vehicle, 0.0, {}});
+        served.erase(served.begin() + seed);
+        while ((int)removed.size() < q)
+        {
+            std::uniform_int_distribution<size_t> pick_removed(0, removed.size() - 1);
+            int anchor = removed[pick_removed(rng)].request_removed;
+            std::sort(served.begin(), served.end(), [&](ServedRequest const &a, ServedRequest const &b)
+                      { return relatedness(I, anchor, a.request) < relatedness(I, anchor, b.request); });
+            size_t pick = rank_select(served.size(), randomness, rng);
+            removed.push_back(LN::RequestPair{served[pick].request, served[pick].vehicle, 0.0, {}});
+            served.erase(served.begin() + pick);
+        }
+        break;
+    }
+    case Destroy::ROUTE:
+    {
+        std::uniform_int_distribution<size_t> uni(0, served.size() - 1);
+        int vehicle = served[uni(rng)].vehicle; // non empty, weighted by route size
+        for (auto const &s : served)
+            if (s.vehicle == vehicle)
+                removed.push_back(LN::RequestPair{s.request, s.vehicle, 0.0, {}});
+        break;
+    }
+    }
+    return removed;
+}
+
+std::vector<LN::RequestPair> ALNS::repair(Instance const &I, std::vector<std::vector<int>> &routes, Repair op, int to_add, int regret_k)
+{
+    return REGRET::insert(I, routes, to_add, op == Repair::REGRET ? std::max(2, regret_k) : 1);
+}
+
+Solution ALNS::alns(Instance const &I, Solution const &sol, size_t iters, Params const &params, std::vector<double> *objectives_over_time, CancellationToken const *cancel, IncumbentObserver *observer, std::vector<OperatorStats> *stats, rng::Engine *engine)
+{
+    RunClock clock;
+    auto start = std::chrono::steady_clock::now();
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
+    std::uniform_real_distribution<double> uni(0.0, 1.0);
+
+    std::vector<Destroy> destroy_ops = {Destroy::RANDOM, Destroy::WORST, Destroy::SHAW, Destroy::ROUTE};
+    std::vector<Repair> repair_ops = {Repair::GREEDY, Repair::REGRET};
+    Portfolio destroyers({"random", "worst", "shaw", "route"});
+    Portfolio repairers({"greedy", "regret"});
+
+    Encoding current(I, sol);
+    Solution current_sol = sol;
+    double current_objective = utils::objective(I, sol);
+    Solution best_sol = sol;
+    double best_objective = current_objective;
+    notify_incumbent(observer, clock, 0, best_objective, best_sol);
+
+    // Ropke & Pisinger: start_worse worse than the initial solution is accepted with probability 0.5.
+    double T_start = std::max(params.start_worse * current_objective / std::log(2.0), 1e-9);
+    double T_end = T_start * params.end_ratio;
+
+    for (size_t iter = 0; iter < iters; ++iter)
+    {
+        if (cancel && cancel->is_cancelled())
+            break;
+        double progress = (double)iter / iters;
+        if (params.time_limit_ms > 0.0)
+        {
+            double used = elapsed_ms(start) / params.time_limit_ms;
+            if (used >= 1.0)
+                break;
+            progress = std::max(progress, used);
+        }
+        double T = T_start * std::pow(T_end / T_start, progress);
+
+        int served = current.total_num_of_requests();
+        int q_max = std::min(params.max_remove, served - 1);
+        int q_min = std::min(params.min_remove, q_max);
+        if (q_max < 1)
+            break;
+        int q = std::uniform_int_distribution<int>(q_min, q_max)(rng);
+
+        int d = destroyers.select(rng);
+        int r = repairers.select(rng);
+
+        auto t_destroy = std::chrono::steady_clock::now();
+        auto removed = destroy(I, current_sol, destroy_ops[d], q, params.randomness, rng);
+        auto routes = current_sol.routes;
+        remove_from_routes(I, routes, removed);
+        destroyers.record_time(d, elapsed_ms(t_destroy));
+
+        auto t_repair = std::chrono::steady_clock::now();
+        int to_add = std::max(0, I.gamma - (served - (int)removed.size()));
+        auto added = repair(I, routes, repair_ops[r], to_add, params.regret_k);
+        repairers.record_time(r, elapsed_ms(t_repair));
+
+        double score = 0.0;
+        bool new_best = false, improved = false, accepted = false;
+        if ((int)added.size() == to_add)
+        {
+            Encoding candidate = LN::apply_addition(I, LN::apply_removal(I, current, removed), added);
+
+            // The repaired routes are a valid decoding of candidate as well, keep the better one.
+            Solution decoded = candidate.to_sol(I, params.beam_width, cancel);
+            Solution repaired;
+            repaired.routes = std::move(routes);
+            repaired.fairness = I.fairness;
+            repaired.compute_cached_values_from_routes(I);
+            double decoded_objective = utils::objective(I, decoded);
+            double repaired_objective = utils::objective(I, repaired);
+            Solution &candidate_sol = decoded_objective <= repaired_objective ? decoded : repaired;
+            double candidate_objective = std::min(decoded_objective, repaired_objective);
+
+            double delta = candidate_objective - current_objective;
+            accepted = delta < 0.0 || uni(rng) < std::exp(-delta / T);
+            if (accepted)
+            {
+                improved = delta < 0.0;
+                current = std::move(candidate);
+                current_sol = std::move(candidate_sol);
+                current_objective = candidate_objective;
+                if (current_objective < best_objective)
+                {
+                    new_best = true;
+                    best_objective = current_objective;
+                    best_sol = current_sol;
+                    notify_incumbent(observer, clock, iter + 1, best_objective, best_sol);
+                }
+                score = new_best ? params.sigma_best : (improved ? params.sigma_better : params.sigma_accepted);
+            }
+        }
+        destroyers.record_score(d, score, new_best, improved, accepted);
+        repairers.record_score(r, score, new_best, improved, accepted);
+
+        if ((iter + 1) % params.segment == 0)
+        {
+            destroyers.update_weights(params.reaction);
+            repairers.update_weights(params.reaction);
+        }
+
+        if (objectives_over_time)
+            objectives_over_time->push_back(best_objective);
+    }
+
+    if (stats)
+    {
+        *stats = destroyers.stats;
+        stats->insert(stats->end(), repairers.stats.begin(), repairers.stats.end());
+    }
+    assert(best_sol.is_solution_feasible(I));
+    return best_sol;
+}
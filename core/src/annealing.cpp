@@ -0,0 +1,424 @@
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include "annealing.hpp"
+
+namespace
+{
+    // Uniform in [0, n), n > 0. Multiply-shift, no division.
+    inline int below(rng::Engine &rng, int n)
+    {
+        return (int)(((unsigned __int128)rng() * (uint64_t)n) >> 64);
+    }
+}
+
+AnnealingState::AnnealingState(Instance const &I_, Solution const &sol)
+    : I(&I_),
+      fairness_name(sol.fairness.empty() ? I_.fairness : sol.fairness),
+      routes(sol.routes),
+      route_of(2 * I_.n + 1, -1),
+      pos_of(2 * I_.n + 1, -1)
+{
+    if (fairness_name == "jain")
+        fairness = Fairness::JAIN;
+    else if (fairness_name == "gini")
+        fairness = Fairness::GINI;
+    else if (fairness_name == "maxmin")
+        fairness = Fairness::MAXMIN;
+    else
+    {
+        std::cerr << "AnnealingState: unknown fairness " << fairness_name << std::endl;
+        std::abort();
+    }
+
+    routes.resize(I->nK);
+    loads.resize(I->nK);
+    dists.resize(I->nK);
+    for (int r = 0; r < I->nK; r++)
+    {
+        loads[r].resize(routes[r].size());
+        for (int node : routes[r])
+            route_of[node] = r;
+        reindex(r, 0, (int)routes[r].size());
+        served_nodes += routes[r].size();
+    }
+    refresh();
+}
+
+void AnnealingState::refresh()
+{
+    sum = 0.0;
+    sum_squares = 0.0;
+    for (int r = 0; r < I->nK; r++)
+    {
+        dists[r] = utils::calc_route_distance(*I, routes[r]);
+        sum += dists[r];
+        sum_squares += dists[r] * dists[r];
+    }
+    gini_sum = fairness == Fairness::GINI ? utils::gini_cefficient_nominator(*I, dists) : 0.0;
+    f = objective_with(0, dists[0], -1, 0.0);
+}
+
+void AnnealingState::reindex(int r, int from, int to)
+{
+    auto const &route = routes[r];
+    int load = load_before(r, from);
+    for (int i = from; i < to; i++)
+    {
+        int node = route[i];
+        pos_of[node] = i;
+        load += I->load_change[node];
+        loads[r][i] = load;
+    }
+}
+
+double AnnealingState::abs_diff_sum(double value, int skip1, int skip2) const
+{
+    double total = 0.0;
+    for (int j = 0; j < (int)dists.size(); j++)
+        if (j != skip1 && j != skip2)
+            total += std::abs(value - dists[j]);
+    return total;
+}
+
+AnnealingState::Sums AnnealingState::sums_with(int r1, double d1, int r2, double d2) const
+{
+    double o1 = dists[r1];
+    Sums s{sum - o1 + d1, sum_squares - o1 * o1 + d1 * d1, gini_sum};
+    if (r2 >= 0)
+    {
+        double o2 = dists[r2];
+        s.sum += d2 - o2;
+        s.squares += d2 * d2 - o2 * o2;
+    }
+    if (fairness == Fairness::GINI)
+    {
+        s.gini += abs_diff_sum(d1, r1, r2) - abs_diff_sum(o1, r1, r2);
+        if (r2 >= 0)
+            s.gini += abs_diff_sum(d2, r1, r2) - abs_diff_sum(dists[r2], r1, r2) +
+                      std::abs(d1 - d2) - std::abs(o1 - dists[r2]);
+    }
+    return s;
+}
+
+double AnnealingState::objective_with(int r1, double d1, int r2, double d2) const
+{
+    Sums s = sums_with(r1, d1, r2, d2);
+
+    // Same formulas as utils::objective. A solution without any distance counts as fair.
+    double fair = 1.0;
+    switch (fairness)
+    {
+    case Fairness::JAIN:
+        if (s.squares > 0.0)
+            fair = s.sum * s.sum / (I->nK * s.squares);
+        break;
+    case Fairness::GINI:
+        if (s.sum > 0.0)
+            fair = 1.0 - s.gini / s.sum;
+        break;
+    case Fairness::MAXMIN:
+    {
+        double min = r1 == 0 ? d1 : (r2 == 0 ? d2 : dists[0]);
+        double max = min;
+        for (int j = 1; j < (int)dists.size(); j++)
+        {
+            double d = j == r1 ? d1 : (j == r2 ? d2 : dists[j]);
+            min = std::min(min, d);
+            max = std::max(max, d);
+        }
+        if (max > 0.0)
+            fair = min / max;
+        break;
+    }
+    }
+    return s.sum + I->rho * (1.0 - fair);
+}
+
+std::optional<AnnealingState::Move> AnnealingState::propose(rng::Engine &rng, double threshold) const
+{
+    switch (below(rng, 3))
+    {
+    case 0:
+        return propose_swap(rng, threshold);
+    case 1:
+        return propose_two_opt(rng, threshold);
+    default:
+        return propose_relocate(rng, threshold);
+    }
+}
+
+std::optional<AnnealingState::Move> AnnealingState::propose_swap(rng::Engine &rng, double threshold) const
+{
+    int r = below(rng, I->nK);
+    auto const &route = routes[r];
+    int L = (int)route.size();
+    if (L < 2)
+        return std::nullopt;
+
+    int a = below(rng, L - 1);
+    int b = a + 1 + below(rng, std::min(MAX_SPAN, L - 1 - a));
+    int x = route[a];
+    int y = route[b];
+    int prev = node_at(r, a - 1);
+    int next = node_at(r, b + 1);
+    auto const &d = I->dist;
+
+    double removed, added;
+    if (b == a + 1)
+    {
+        removed = d[prev][x] + d[x][y] + d[y][next];
+        added = d[prev][y] + d[y][x] + d[x][next];
+    }
+    else
+    {
+        int after_x = route[a + 1];
+        int before_y = route[b - 1];
+        removed = d[prev][x] + d[x][after_x] + d[before_y][y] + d[y][next];
+        added = d[prev][y] + d[y][after_x] + d[before_y][x] + d[x][next];
+    }
+    double new_dist = dists[r] + added - removed;
+    double delta = objective_with(r, new_dist, -1, 0.0) - f;
+    if (!(delta < threshold))
+        return std::nullopt;
+
+    // x moves back past its delivery, or y moves ahead of its pickup.
+    int n = I->n;
+    if (x <= n && pos_of[x + n] <= b)
+        return std::nullopt;
+    if (y > n && pos_of[y - n] >= a)
+        return std::nullopt;
+
+    // Stops a..b-1 now carry y instead of x.
+    int diff = I->load_change[y] - I->load_change[x];
+    if (diff > 0)
+        for (int i = a; i < b; i++)
+            if (loads[r][i] + diff > I->C)
+                return std::nullopt;
+
+    return Move{Move::SWAP, r, a, b, -1, 0, 0, new_dist, 0.0, delta};
+}
+
+std::optional<AnnealingState::Move> AnnealingState::propose_two_opt(rng::Engine &rng, double threshold) const
+{
+    int r = below(rng, I->nK);
+    auto const &route = routes[r];
+    int L = (int)route.size();
+    if (L < 2)
+        return std::nullopt;
+
+    int a = below(rng, L - 1);
+    int b = a + 1 + below(rng, std::min(MAX_SPAN, L - 1 - a));
+    int prev = node_at(r, a - 1);
+    int next = node_at(r, b + 1);
+    auto const &d = I->dist;
+
+    // Distances are symmetric (checked when the instance is loaded), the inside is unchanged.
+    double new_dist = dists[r] + d[prev][route[b]] + d[route[a]][next] - d[prev][route[a]] - d[route[b]][next];
+    double delta = objective_with(r, new_dist, -1, 0.0) - f;
+    if (!(delta < threshold))
+        return std::nullopt;
+
+    int n = I->n;
+    int load = load_before(r, a);
+    for (int i = b; i >= a; i--)
+    {
+        int node = route[i];
+        // A request with both stops inside would be delivered before its pickup.
+        if (node <= n && pos_of[node + n] <= b)
+            return std::nullopt;
+        load += I->load_change[node];
+        if (load > I->C)
+            return std::nullopt;
+    }
+
+    return Move{Move::TWO_OPT, r, a, b, -1, 0, 0, new_dist, 0.0, delta};
+}
+
+std::optional<AnnealingState::Move> AnnealingState::propose_relocate(rng::Engine &rng, double threshold) const
+{
+    if (I->nK < 2)
+        return std::nullopt;
+
+    int r = below(rng, I->nK);
+    int L = (int)routes[r].size();
+    if (L == 0)
+        return std::nullopt;
+
+    int n = I->n;
+    int node = routes[r][below(rng, L)];
+    int x = node <= n ? node : node - n;
+    int y = x + n;
+    int a = pos_of[x];
+    int b = pos_of[y];
+
+    int to = below(rng, I->nK - 1);
+    if (to >= r)
+        to++;
+    int L2 = (int)routes[to].size();
+    int c = below(rng, L2 + 1);
+    int e = c + below(rng, std::min(MAX_SPAN, L2 - c) + 1);
+    auto const &d = I->dist;
+
+    double from_dist;
+    int before_x = node_at(r, a - 1);
+    int after_y = node_at(r, b + 1);
+    if (L == 2)
+        from_dist = 0.0;
+    else if (b == a + 1)
+        from_dist = dists[r] - d[before_x][x] - d[x][y] - d[y][after_y] + d[before_x][after_y];
+    else
+    {
+        int after_x = routes[r][a + 1];
+        int before_y = routes[r][b - 1];
+        from_dist = dists[r] - d[before_x][x] - d[x][after_x] + d[before_x][after_x] -
+                    d[before_y][y] - d[y][after_y] + d[before_y][after_y];
+    }
+
+    double to_dist;
+    int before_c = node_at(to, c - 1);
+    int at_c = node_at(to, c);
+    if (c == e)
+        to_dist = dists[to] + d[before_c][x] + d[x][y] + d[y][at_c] - d[before_c][at_c];
+    else
+    {
+        int before_e = routes[to][e - 1];
+        int at_e = node_at(to, e);
+        to_dist = dists[to] + d[before_c][x] + d[x][at_c] - d[before_c][at_c] +
+                  d[before_e][y] + d[y][at_e] - d[before_e][at_e];
+    }
+
+    double delta = objective_with(r, from_dist, to, to_dist) - f;
+    if (!(delta < threshold))
+        return std::nullopt;
+
+    // Removing a request never overloads, carrying it does from its pickup to its delivery.
+    int demand = I->load_change[x];
+    if (load_before(to, c) + demand > I->C)
+        return std::nullopt;
+    for (int i = c; i < e; i++)
+        if (loads[to][i] + demand > I->C)
+            return std::nullopt;
+
+    return Move{Move::RELOCATE, r, a, b, to, c, e, from_dist, to_dist, delta};
+}
+
+void AnnealingState::apply(Move const &mov)
+{
+    int r = mov.route;
+    int to = mov.to_route;
+    double to_dist = to >= 0 ? mov.to_route_distance : 0.0;
+
+    // Sums first, they are taken against the old distances.
+    Sums s = sums_with(r, mov.route_distance, to, to_dist);
+    f = objective_with(r, mov.route_distance, to, to_dist);
+    sum = s.sum;
+    sum_squares = s.squares;
+    gini_sum = s.gini;
+    dists[r] = mov.route_distance;
+    if (to >= 0)
+        dists[to] = to_dist;
+
+    auto &route = routes[r];
+    switch (mov.type)
+    {
+    case Move::SWAP:
+        std::swap(route[mov.a], route[mov.b]);
+        reindex(r, mov.a, mov.b + 1);
+        break;
+    case Move::TWO_OPT:
+        std::reverse(route.begin() + mov.a, route.begin() + mov.b + 1);
+        reindex(r, mov.a, mov.b + 1);
+        break;
+    case Move::RELOCATE:
+    {
+        int x = route[mov.a];
+        int y = route[mov.b];
+        route.erase(route.begin() + mov.b);
+        route.erase(route.begin() + mov.a);
+        loads[r].resize(route.size());
+        reindex(r, mov.a, (int)route.size());
+
+        auto &target = routes[to];
+        target.insert(target.begin() + mov.e, y);
+        target.insert(target.begin() + mov.c, x);
+        loads[to].resize(target.size());
+        reindex(to, mov.c, (int)target.size());
+        route_of[x] = to;
+        route_of[y] = to;
+        break;
+    }
+    }
+}
+
+void AnnealingState::write_solution(Solution &sol) const
+{
+    sol.routes.resize(routes.size());
+    for (size_t r = 0; r < routes.size(); r++)
+        sol.routes[r].assign(routes[r].begin(), routes[r].end());
+    sol.routes_distances = dists;
+    sol.total_distance = sum;
+    sol.sum_of_squares = sum_squares;
+    sol.fairness = fairness_name;
+}
+
+Solution AnnealingState::solution() const
+{
+    Solution sol;
+    write_solution(sol);
+    return sol;
+}
+
+AnnealingChain::AnnealingChain(Instance const &I, Solution const &sol)
+    : current(I, sol),
+      base(current),
+      best(current),
+      max_trail(std::max<size_t>(1024, current.num_nodes())),
+      best_f(current.objective())
+{
+}
+
+AnnealingChain::Step AnnealingChain::step(rng::Engine &rng, double T)
+{
+    auto mov = current.propose(rng, AnnealingState::acceptance_threshold(T, rng));
+    if (!mov.has_value())
+        return REJECTED;
+    return apply(*mov) ? IMPROVED : ACCEPTED;
+}
+
+bool AnnealingChain::apply(AnnealingState::Move const &mov)
+{
+    current.apply(mov);
+    trail.push_back(mov);
+
+    bool improved = current.objective() < best_f;
+    if (improved)
+    {
+        best_f = current.objective();
+        best_len = trail.size();
+    }
+
+    if (trail.size() >= max_trail)
+    {
+        if (best_len > 0)
+        {
+            best = base;
+            for (size_t k = 0; k < best_len; k++)
+                best.apply(trail[k]);
+        }
+        current.refresh();
+        base = current;
+        trail.clear();
+        best_len = 0;
+    }
+    return improved;
+}
+
+Solution AnnealingChain::best_solution() const
+{
+    AnnealingState replay = best_len > 0 ? base : best;
+    for (size_t k = 0; k < best_len; k++)
+        replay.apply(trail[k]);
+    replay.refresh();
+    return replay.solution();
+}
@@ -1,5 +1,7 @@
 #include <vector>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <limits>
 #include <cassert>
 #include <iostream>
@@ -22,194 +24,278 @@ std::vector<int> create_simple_sequential_route(Instance const &I, std::vector<i
     return route;
 }
 
-std::vector<int> create_track_route(Instance const &I, int beam_width, std::vector<int> const &requests)
+namespace
 {
+    // Zobrist keys. A state is identified by its active and remaining sets plus its last node
+    // (cargo follows from the active set). Two states with the same key can be completed the same
+    // way, so the one with the larger score is dominated.
+    enum ZobristKind
+    {
+        REMAINING = 0,
+        ACTIVE = 1,
+        LAST_NODE = 2
+    };
 
-    if (requests.empty())
+    inline uint64_t zobrist(int id, ZobristKind kind)
     {
-        std::cerr << " In create_track_route -> requests were empty !!!" << std::endl;
-        return {};
+        // splitmix64 finalizer
+        uint64_t x = (uint64_t)id * 3 + kind + 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
     }
 
-    std::vector<BS::BeamState> beam_states{BS::BeamState{
-        0, 0.0, {}, {}, requests}};
+    // A possible extension of a beam state. Only the selected ones become BeamStates.
+    struct Expansion
+    {
+        double score;
+        uint64_t key; // hash of the sets of the child xor its last node
+        int slot;     // position of the parent in the current beam
+        int local;    // index into requests
+        bool pickup;
+    };
+
+    // Max-heap on score (worst on top). Own sift functions since a merged duplicate
+    // changes the score of an element in the middle of the heap.
+    inline void sift_up(std::vector<Expansion> &heap, size_t i)
+    {
+        while (i > 0)
+        {
+            size_t parent = (i - 1) / 2;
+            if (heap[parent].score >= heap[i].score)
+                break;
+            std::swap(heap[parent], heap[i]);
+            i = parent;
+        }
+    }
 
-    size_t max_steps = 4 * requests.size();
+    inline void sift_down(std::vector<Expansion> &heap, size_t i)
+    {
+        for (;;)
+        {
+            size_t largest = i;
+            size_t l = 2 * i + 1, r = 2 * i + 2;
+            if (l < heap.size() && heap[l].score > heap[largest].score)
+                largest = l;
+            if (r < heap.size() && heap[r].score > heap[largest].score)
+                largest = r;
+            if (largest == i)
+                break;
+            std::swap(heap[largest], heap[i]);
+            i = largest;
+        }
+    }
 
-    for (size_t step = 0; step < max_steps; ++step)
+    // Keeps the best `width` distinct expansions. Expansions that do not beat the current
+    // worst are rejected without being stored; a duplicate key keeps only the better score.
+    inline void offer_expansion(std::vector<Expansion> &heap, int width, Expansion const &e)
     {
-        std::vector<BS::BeamState> new_beam;
+        bool full = (int)heap.size() >= width;
+        if (full && e.score >= heap.front().score)
+            return;
 
-        for (const auto &st : beam_states)
+        for (size_t i = 0; i < heap.size(); i++)
         {
-            if (st.active.empty() && st.remaining.empty())
-            {
-                new_beam.push_back(st);
+            if (heap[i].key != e.key)
                 continue;
+            if (e.score < heap[i].score)
+            {
+                heap[i] = e;
+                sift_down(heap, i);
             }
+            return;
+        }
 
-            // Pickups
-            for (int req : st.remaining)
-            {
-                if (st.cargo + I.demands[req] <= I.C)
-                {
-                    int p = 1 + req;
+        if (!full)
+        {
+            heap.push_back(e);
+            sift_up(heap, heap.size() - 1);
+        }
+        else
+        {
+            heap.front() = e;
+            sift_down(heap, 0);
+        }
+    }
 
-                    if (p < 0 || p >= I.dist.size())
-                    {
-                        std::cerr << "ERROR: Invalid pickup node " << p << " for request " << req << std::endl;
-                        continue;
-                    }
+    // Scratch memory of create_track_route. It lives per thread and is only cleared
+    // between calls, so once warm a call does not allocate.
+    struct BeamArena
+    {
+        std::vector<BS::BeamState> states; // every materialized state, linked by parent
+        std::vector<int> beam, next_beam;  // indices into states
+        // Per beam slot 2 * words words: the active set followed by the remaining set.
+        std::vector<uint64_t> bits, next_bits;
+        std::vector<uint64_t> hashes, next_hashes; // Zobrist hash of the sets per beam slot
+        std::vector<Expansion> expansions; // bounded heap of the next beam
+    };
+}
 
-                    std::vector<int> new_route = st.route;
-                    new_route.push_back(p);
+std::vector<int> create_track_route(Instance const &I, int beam_width, std::vector<int> const &requests, CancellationToken const *cancel)
+{
 
-                    std::vector<int> new_active = st.active;
-                    new_active.push_back(req);
+    if (requests.empty())
+    {
+        std::cerr << " In create_track_route -> requests were empty !!!" << std::endl;
+        return {};
+    }
 
-                    std::vector<int> new_remaining;
-                    new_remaining.reserve(st.remaining.size() - 1);
-                    for (int r : st.remaining)
-                    {
-                        if (r != req)
-                            new_remaining.push_back(r);
-                    }
+    static thread_local BeamArena arena;
+    auto &states = arena.states;
+    auto &beam = arena.beam;
+    auto &next_beam = arena.next_beam;
+    auto &bits = arena.bits;
+    auto &next_bits = arena.next_bits;
+    auto &hashes = arena.hashes;
+    auto &next_hashes = arena.next_hashes;
+    auto &expansions = arena.expansions;
+
+    size_t const L = requests.size();
+    size_t const words = (L + 63) / 64;
+    size_t const stride = 2 * words;
+
+    states.clear();
+    beam.clear();
+    bits.assign(stride, 0);
+    hashes.assign(1, 0);
+    for (size_t li = 0; li < L; li++)
+    {
+        bits[words + li / 64] |= uint64_t(1) << (li % 64);
+        hashes[0] ^= zobrist(requests[li], REMAINING);
+    }
 
-                    int last = st.route.empty() ? 0 : st.route.back();
+    states.push_back(BS::BeamState{0, -1, 0, 0.0});
+    beam.push_back(0);
 
-                    if (last < 0 || last >= I.dist.size() || p >= I.dist[last].size())
-                    {
-                        std::cerr << "ERROR: Invalid dist access [" << last << "][" << p << "]" << std::endl;
-                        continue;
-                    }
+    // Every step appends one node to every state, so all states are complete after 2L steps.
+    size_t max_steps = 2 * L;
 
-                    double new_score = st.score + I.dist[last][p];
+    for (size_t step = 0; step < max_steps; ++step)
+    {
+        // Once cancelled only the best state survives, i.e. the rest of the route is greedy.
+        if (beam_width > 1 && cancel && cancel->is_cancelled())
+            beam_width = 1;
 
-                    new_beam.push_back(BS::BeamState{
-                        st.cargo + I.demands[req],
-                        new_score,
-                        std::move(new_route),
-                        std::move(new_active),
-                        std::move(new_remaining)});
-                }
-            }
+        expansions.clear();
 
-            // Deliveries
-            for (int req : st.active)
-            {
-                int d = 1 + I.n + req;
+        for (size_t slot = 0; slot < beam.size(); ++slot)
+        {
+            auto const st = states[beam[slot]];
+            uint64_t const hash = hashes[slot];
 
-                if (d < 0 || d >= I.dist.size())
-                {
-                    std::cerr << "ERROR: Invalid delivery node " << d << " for request " << req << std::endl;
-                    continue;
-                }
+            // Distances are non negative, so no expansion of this state can enter a full heap.
+            if ((int)expansions.size() == beam_width && st.score >= expansions.front().score)
+                continue;
 
-                std::vector<int> new_route = st.route;
-                new_route.push_back(d);
-                int new_cargo = st.cargo - I.demands[req];
+            uint64_t const *active = &bits[slot * stride];
+            uint64_t const *remaining = active + words;
 
-                std::vector<int> new_active;
-                new_active.reserve(st.active.size() - 1);
-                for (int r : st.active)
+            // Pickups
+            for (size_t w = 0; w < words; w++)
+            {
+                for (uint64_t word = remaining[w]; word; word &= word - 1)
                 {
-                    if (r != req)
-                        new_active.push_back(r);
+                    int local = (int)(w * 64 + std::countr_zero(word));
+                    int req = requests[local];
+                    if (st.cargo + I.demands[req] > I.C)
+                        continue;
+                    double score = st.score + I.dist[st.node][1 + req];
+                    uint64_t key = hash ^ zobrist(req, REMAINING) ^ zobrist(req, ACTIVE) ^ zobrist(1 + req, LAST_NODE);
+                    offer_expansion(expansions, beam_width, Expansion{score, key, (int)slot, local, true});
                 }
+            }
 
-                std::vector<int> new_remaining = st.remaining;
-
-                int last = st.route.empty() ? 0 : st.route.back();
-
-                if (last < 0 || last >= I.dist.size() || d >= I.dist[last].size())
+            // Deliveries
+            for (size_t w = 0; w < words; w++)
+            {
+                for (uint64_t word = active[w]; word; word &= word - 1)
                 {
-                    std::cerr << "ERROR: Invalid dist access [" << last << "][" << d << "]" << std::endl;
-                    continue;
+                    int local = (int)(w * 64 + std::countr_zero(word));
+                    int req = requests[local];
+                    double score = st.score + I.dist[st.node][1 + I.n + req];
+                    uint64_t key = hash ^ zobrist(req, ACTIVE) ^ zobrist(1 + I.n + req, LAST_NODE);
+                    offer_expansion(expansions, beam_width, Expansion{score, key, (int)slot, local, false});
                 }
-
-                double new_score = st.score + I.dist[last][d];
-
-                new_beam.push_back(BS::BeamState{
-                    new_cargo,
-                    new_score,
-                    std::move(new_route),
-                    std::move(new_active),
-                    std::move(new_remaining)});
             }
         }
 
-        if (new_beam.empty())
+        if (expansions.empty())
         {
             std::cerr << "WARNING: Beam became empty at step " << step << std::endl;
             break;
         }
 
-        std::sort(new_beam.begin(), new_beam.end(),
-                  [](const BS::BeamState &a, const BS::BeamState &b)
-                  {
-                      return a.score < b.score;
-                  });
-
-        if ((int)new_beam.size() > beam_width)
-            new_beam.resize(beam_width);
-
-        beam_states = std::move(new_beam);
-
-        bool all_complete = true;
-        for (const auto &st : beam_states)
+        // Materialize the survivors.
+        next_beam.clear();
+        next_hashes.clear();
+        next_bits.resize(expansions.size() * stride);
+        for (size_t i = 0; i < expansions.size(); i++)
         {
-            if (!st.active.empty() || !st.remaining.empty())
+            auto const &e = expansions[i];
+            auto const &parent = states[beam[e.slot]];
+            uint64_t *dst = &next_bits[i * stride];
+            std::copy_n(&bits[e.slot * stride], stride, dst);
+
+            int req = requests[e.local];
+            uint64_t mask = uint64_t(1) << (e.local % 64);
+            BS::BeamState child{0, beam[e.slot], parent.cargo, e.score};
+            if (e.pickup)
             {
-                all_complete = false;
-                break;
+                dst[words + e.local / 64] &= ~mask;
+                dst[e.local / 64] |= mask;
+                child.node = 1 + req;
+                child.cargo += I.demands[req];
+            }
+            else
+            {
+                dst[e.local / 64] &= ~mask;
+                child.node = 1 + I.n + req;
+                child.cargo -= I.demands[req];
             }
+            next_hashes.push_back(e.key ^ zobrist(child.node, LAST_NODE));
+            next_beam.push_back((int)states.size());
+            states.push_back(child);
         }
 
-        if (all_complete)
-            break;
+        std::swap(beam, next_beam);
+        std::swap(bits, next_bits);
+        std::swap(hashes, next_hashes);
     }
 
     double best_score = std::numeric_limits<double>::infinity();
-    std::vector<int> best_route;
+    int best_state = -1;
 
-    for (size_t idx = 0; idx < beam_states.size(); ++idx)
+    for (size_t slot = 0; slot < beam.size(); ++slot)
     {
-        const auto &st = beam_states[idx];
-
-        if (!st.active.empty() || !st.remaining.empty())
+        uint64_t const *set = &bits[slot * stride];
+        if (std::any_of(set, set + stride, [](uint64_t w)
+                        { return w != 0; }))
         {
-            std::cout << "[SELECT] Skipping incomplete state " << idx << std::endl;
+            std::cout << "[SELECT] Skipping incomplete state " << slot << std::endl;
             continue;
         }
 
-        std::vector<int> final_route = st.route;
-        for (size_t i = 0; i < final_route.size(); ++i)
-        {
-            int node = final_route[i];
-            if (node < 0 || node >= I.dist.size())
-            {
-                std::cerr << "ERROR: Invalid node " << node << " at position " << i
-                          << " in route of size " << final_route.size() << std::endl;
-                return {};
-            }
-        }
-
-        double d = utils::calc_route_distance(I, final_route);
-
+        auto const &st = states[beam[slot]];
+        double d = st.score + I.dist[st.node][0];
         if (d < best_score)
         {
             best_score = d;
-            best_route = std::move(final_route);
+            best_state = beam[slot];
         }
     }
 
-    if (best_route.empty())
+    if (best_state == -1)
     {
         std::cerr << "ERROR: No complete route found for " << requests.size() << " requests" << std::endl;
         return create_simple_sequential_route(I, requests);
     }
 
-    assert(best_route.size() == 2 * requests.size());
+    std::vector<int> best_route(2 * L);
+    size_t pos = best_route.size();
+    for (int idx = best_state; states[idx].parent != -1; idx = states[idx].parent)
+        best_route[--pos] = states[idx].node;
+
+    assert(pos == 0);
 
     return best_route;
 }
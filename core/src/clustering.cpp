@@ -7,12 +7,15 @@
 #include "structures.hpp"
 
 clusters::ClusterCenters::ClusterCenters(const Instance &I, std::vector<int> const &reqs)
+    : ClusterCenters(I, reqs, rng::thread_engine())
+{
+}
+
+clusters::ClusterCenters::ClusterCenters(const Instance &I, std::vector<int> const &reqs, rng::Engine &gen)
     : centers(I.nK, {0.0, 0.0})
 {
     std::vector<int> indices = reqs;
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
     std::shuffle(indices.begin(), indices.end(), gen);
 
     int used = std::min(I.nK, (int)indices.size());
@@ -101,8 +104,9 @@ std::vector<int> clusters::balanced_assign(
 std::vector<int> clusters::balanced_kmeans(
     const Instance &I,
     const std::vector<int> &reqs,
-    int iters = 20,
-    int restarts = 20)
+    int iters,
+    int restarts,
+    rng::Engine *gen)
 {
     double total_dem = 0.0;
     for (int r : reqs)
@@ -114,7 +118,7 @@ std::vector<int> clusters::balanced_kmeans(
 
     for (int s = 0; s < restarts; ++s)
     {
-        ClusterCenters C(I, reqs);
+        ClusterCenters C(I, reqs, gen ? *gen : rng::thread_engine());
         std::vector<int> assign(reqs.size(), 0);
 
         for (int it = 0; it < iters; ++it)
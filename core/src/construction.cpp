@@ -119,7 +119,7 @@ auto select_gamma_requests(Instance const &I)
 }
 
 Solution DC::construction(
-    const Instance &I)
+    const Instance &I, rng::Engine *gen)
 {
 
     auto indices_of_requests_to_serve = select_gamma_requests(I);
@@ -129,7 +129,7 @@ Solution DC::construction(
         throw std::runtime_error("Assertion failed");
     }
 
-    std::vector<int> assign = clusters::balanced_kmeans(I, indices_of_requests_to_serve, 20, 20);
+    std::vector<int> assign = clusters::balanced_kmeans(I, indices_of_requests_to_serve, 20, 20, gen);
     gt::Matrix<int> per_track(I.nK); // per track requests-responibilities
 
 
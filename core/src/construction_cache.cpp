@@ -0,0 +1,68 @@
+#include "construction_cache.hpp"
+#include "solvers.hpp"
+
+ConstructionCache &ConstructionCache::global()
+{
+    static ConstructionCache cache;
+    return cache;
+}
+
+Solution ConstructionCache::beam_search(Instance const &I, double alpha, int beam_width)
+{
+    Key key{I.name, I.n, I.nK, I.C, I.gamma, "BS", alpha, beam_width};
+    return get_or_build(key, [&]
+                        { return BS::beam_search(I, alpha, beam_width); });
+}
+
+Solution ConstructionCache::dc(Instance const &I, unsigned seed)
+{
+    Key key{I.name, I.n, I.nK, I.C, I.gamma, "DC", 0.0, (int)seed};
+    return get_or_build(key, [&]
+                        {
+        rng::Engine gen(seed);
+        return DC::construction(I, &gen); });
+}
+
+Solution ConstructionCache::get_or_build(Key const &key, std::function<Solution()> const &build)
+{
+    std::promise<Solution> promise;
+    std::shared_future<Solution> future;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = entries.find(key);
+        if (it != entries.end())
+            future = it->second;
+        else
+            entries.emplace(key, promise.get_future().share());
+    }
+    // Someone else builds it, or already did. The builder is running, so waiting is safe.
+    if (future.valid())
+        return future.get();
+
+    try
+    {
+        Solution sol = build();
+        promise.set_value(sol);
+        return sol;
+    }
+    catch (...)
+    {
+        // Waiting threads get the error, later calls try again.
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.erase(key);
+        throw;
+    }
+}
+
+size_t ConstructionCache::size() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+void ConstructionCache::clear()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.clear();
+}
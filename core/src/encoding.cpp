@@ -1,336 +1,378 @@
+#include "bitwords.hpp"
 #include "solvers.hpp"
+#include "thread_pool.hpp"
 #include <cassert>
 #include <iostream>
 #include <functional>
 #include <algorithm>
+#include <bit>
+#include <limits>
 
-std::vector<int> create_track_route(Instance const &I, int beam_width, std::vector<int> const &requests);
-
-Encoding::Encoding(Instance const &I, Solution const &sol)
+Encoding::Encoding(int num_vehicles, int num_requests)
+    : num_vehicles(num_vehicles), num_requests(num_requests), num_words((num_requests + 63) / 64),
+      vehicle_of_request(num_requests, -1), bits((size_t)num_vehicles * num_words, 0),
+      served_bits(num_words, 0), decoded_routes(num_vehicles)
 {
+    assert(num_vehicles <= std::numeric_limits<int16_t>::max());
+}
 
-    dna.reserve(I.nK);
-    for (size_t j = 0; j < I.nK; j++)
-    {
-        dna.emplace_back(I.n, false);
-    }
-
+Encoding::Encoding(Instance const &I, Solution const &sol) : Encoding(I.nK, I.n)
+{
     for (size_t j = 0; j < sol.routes.size(); j++)
     {
-        auto const route = sol.routes[j];
+        auto const &route = sol.routes[j];
         for (auto node : route)
         {
             assert(node != 0);
             if (node <= I.n)
             {
-                dna[j][node - 1] = true;
+                set_vehicle_for_request(j, node - 1);
             }
         }
     }
 }
 
-void Encoding::set_vehicle_for_request(int vehicle, int request)
+Encoding::Encoding(dna_t &&dna) : Encoding((int)dna.size(), dna.empty() ? 0 : (int)dna[0].size())
 {
-    int rows = dna.size();
-    int cols = dna[0].size();
-
-    for (size_t i = 0; i < rows; i++)
+    for (int vehicle = 0; vehicle < num_vehicles; vehicle++)
     {
-        dna[i][request] = (vehicle == (int)i);
+        assert((int)dna[vehicle].size() == num_requests);
+        for (int request = 0; request < num_requests; request++)
+        {
+            if (!dna[vehicle][request])
+                continue;
+            // A request in two rows is not representable, the first vehicle keeps it.
+            if (vehicle_of_request[request] == -1)
+                set_vehicle_for_request(vehicle, request);
+        }
     }
 }
 
-bool Encoding::is_encoding_correct(Instance const &I) const
+void Encoding::set_vehicle_for_request(int vehicle, int request)
 {
-    size_t rows = dna.size();
-    size_t cols = dna[0].size();
-
-    for (auto col : dna)
+    assert(vehicle >= 0 && vehicle < num_vehicles);
+    assert(request >= 0 && request < num_requests);
+    int previous = vehicle_of_request[request];
+    if (previous == vehicle)
+        return;
+    if (previous == -1)
     {
-        if (col.size() != cols)
-            return false;
+        served++;
+        served_bits[request / 64] |= bit_of(request);
     }
-
-    for (size_t j = 0; j < cols; j++)
+    else
     {
-        // Here we check if a request has more or equal to two routes.
-        // 0, 1 are fine.
-
-        bool flag = true;
-        for (size_t i = 0; i < rows; i++)
-        {
-            // If flag was already false i.e a previous route had this request
-            // and  also the current route has this then something is wrong
-            if (!flag && dna[i][j])
-                return false;
-            flag = !dna[i][j];
-        }
+        word_of(previous, request) &= ~bit_of(request);
+        decoded_routes[previous].reset();
     }
+    vehicle_of_request[request] = (int16_t)vehicle;
+    word_of(vehicle, request) |= bit_of(request);
+    decoded_routes[vehicle].reset();
+    cached_solution.reset();
+}
+
+void Encoding::unset_request(int request)
+{
+    assert(request >= 0 && request < num_requests);
+    int previous = vehicle_of_request[request];
+    if (previous == -1)
+        return;
+    word_of(previous, request) &= ~bit_of(request);
+    decoded_routes[previous].reset();
+    vehicle_of_request[request] = -1;
+    served_bits[request / 64] &= ~bit_of(request);
+    served--;
+    cached_solution.reset();
+}
+
+int Encoding::get_vehicle_of_request(int request) const
+{
+    return vehicle_of_request[request];
+}
+
+bool Encoding::is_served(int request) const
+{
+    return vehicle_of_request[request] != -1;
+}
 
-    if (cols != I.n)
+bool Encoding::is_encoding_correct(Instance const &I) const
+{
+    if (num_requests != I.n)
     {
         std::cerr << " cols of encoding do not match requests in Instance" << std::endl;
         return false;
     }
 
-    return true;
+    // The assignment array and the bitsets have to agree. A request can not be in two routes.
+    int counter = 0;
+    for (int request = 0; request < num_requests; request++)
+    {
+        int vehicle = vehicle_of_request[request];
+        if (vehicle != -1)
+            counter++;
+        if (((served_bits[request / 64] & bit_of(request)) != 0) != (vehicle != -1))
+            return false;
+        for (int row = 0; row < num_vehicles; row++)
+        {
+            bool in_row = (bits[(size_t)row * num_words + request / 64] & bit_of(request)) != 0;
+            if (in_row != (row == vehicle))
+                return false;
+        }
+    }
+    return counter == served;
 }
-Solution Encoding::to_sol(Instance const &I, int beam_width) const
+Solution Encoding::to_sol(Instance const &I, int beam_width, CancellationToken const *cancel) const
 {
-    if(!cached_solution){
-        cached_solution = std::move(_compute_solution(I, beam_width));
-    }
-
-    return *cached_solution;
+    auto cached = cached_solution.load();
+    if (cached && cached->beam_width == beam_width)
+        return cached->sol;
+
+    Solution sol = _compute_solution(I, beam_width, cancel);
+    // Routes built after a cancellation are only greedy. Do not keep them.
+    if (!(cancel && cancel->is_cancelled()))
+        cached_solution.store(std::make_shared<DecodedSolution const>(DecodedSolution{beam_width, sol}));
+    return sol;
 }
 
-Solution Encoding::_compute_solution(Instance const &I, int beam_width) const{
+Solution Encoding::_compute_solution(Instance const &I, int beam_width, CancellationToken const *cancel) const{
 
 
     assert(beam_width>0);
-    Solution new_sol;
-    for (auto const &encoding_route : dna)
+    assert(num_requests == I.n);
+    std::vector<std::shared_ptr<DecodedRoute const>> routes(num_vehicles);
+    std::vector<int> dirty;
+    for (int vehicle = 0; vehicle < num_vehicles; vehicle++)
     {
-        assert(encoding_route.size() == I.n);
-        std::vector<int> route_requests;
-        for (size_t i = 0; i < encoding_route.size(); ++i)
-        {
-            if (encoding_route[i])
-                route_requests.push_back(i);
-        }
-
-        auto route = create_track_route(I, beam_width, route_requests);
-        new_sol.routes.push_back(route);
+        auto decoded = decoded_routes[vehicle].load();
+        if (decoded && decoded->beam_width == beam_width)
+            routes[vehicle] = std::move(decoded);
+        else
+            dirty.push_back(vehicle);
     }
 
+    // Routes are independent of each other. When the population is decoded in parallel this
+    // is the inner level, which keeps the pool busy for encodings with many dirty vehicles.
+    ThreadPool::global().parallel_for(dirty.size(), [&](size_t i)
+                                      {
+        int vehicle = dirty[i];
+        auto cached = cached_track_route(I, beam_width, get_requests_of_route(vehicle), cancel);
+        auto decoded = std::make_shared<DecodedRoute const>(DecodedRoute{std::move(cached.route), cached.distance, beam_width});
+        // Routes built after a cancellation are only greedy. Do not keep them.
+        if (!(cancel && cancel->is_cancelled()))
+            decoded_routes[vehicle].store(decoded);
+        routes[vehicle] = std::move(decoded); });
+
+    Solution new_sol;
+    new_sol.routes.reserve(num_vehicles);
+    for (auto const &decoded : routes)
+        new_sol.routes.push_back(decoded->route);
     new_sol.compute_cached_values_from_routes(I);
     // assert(new_sol.is_solution_feasible(I));
     return new_sol;
 }
 
-int Encoding::total_num_of_requests() const
+void Encoding::inherit_routes(Encoding const &parent)
 {
-    size_t rows = dna.size();
-    size_t cols = dna[0].size();
-
-    int counter = 0;
-    for (size_t col = 0; col < cols; col++)
+    assert(num_vehicles == parent.num_vehicles && num_words == parent.num_words);
+    for (int vehicle = 0; vehicle < num_vehicles; vehicle++)
     {
-
-        for (size_t row = 0; row < rows; row++)
-        {
-            if (dna[row][col])
-            {
-                counter++;
-                break;
-            }
-        }
+        if (decoded_routes[vehicle].load())
+            continue;
+        auto decoded = parent.decoded_routes[vehicle].load();
+        if (!decoded)
+            continue;
+        size_t offset = (size_t)vehicle * num_words;
+        if (std::equal(bits.begin() + offset, bits.begin() + offset + num_words, parent.bits.begin() + offset))
+            decoded_routes[vehicle].store(std::move(decoded));
     }
-    return counter;
 }
 
-Encoding::Encoding(dna_t &&other_dna) : dna(std::move(other_dna)) {}
-
-Encoding Encoding::operator+(Encoding const &other) const
+int Encoding::num_dirty_routes() const
 {
-    static thread_local std::mt19937 rng(std::random_device{}());
-    // std::random_device rd;
-    // std::mt19937 rng(rd());
-    std::uniform_int_distribution<int> dist(0, 1);
+    int dirty = 0;
+    for (auto const &decoded : decoded_routes)
+        dirty += !decoded.load();
+    return dirty;
+}
 
-    dna_t offspring = dna;
-    size_t rows = dna.size();
-    size_t cols = dna[0].size();
+int Encoding::total_num_of_requests() const
+{
+    return served;
+}
 
-    for (size_t col = 0; col < cols; col++)
+uint64_t Encoding::hash() const
+{
+    using rng::mix64;
+    // Chained within a row, summed over the rows so the vehicle order does not matter.
+    uint64_t total = 0;
+    for (int vehicle = 0; vehicle < num_vehicles; vehicle++)
     {
-        size_t r = dist(rng); // flip coin
-        // std::array<size_t, 2> proposed_rows;
-        bool is_set = false;
-        int row_set = -1;
-        for (size_t row = 0; row < rows; row++)
-        {
-            // Possible improvement if we test and. If both are true then we can break early.
-            bool tmp = dna[row][col] || other.dna[row][col];
-            if (!is_set && tmp)
-            {
-                is_set = tmp;
-                row_set = row;
-                offspring[row][col] = tmp;
-            }
-            if (is_set && tmp)
-            {
-                if (r == 1)
-                {
-                    // The second offer wins. Remove the first one and
-                    // add here
-                    offspring[row_set][col] = false;
-                    row_set = row;
-                    offspring[row_set][col] = true;
-                }
-                break; // Break since there is not other true value for this request
-            }
-            // For the rest values offspring[row][col] should be false as in the first dna.
-        }
+        uint64_t const *row = &bits[(size_t)vehicle * num_words];
+        uint64_t h = 0;
+        for (int w = 0; w < num_words; w++)
+            h = mix64(h ^ row[w]);
+        total += mix64(h);
     }
-
-    return {std::move(offspring)};
+    return total;
 }
 
-Encoding Encoding::add(Instance const &I, Encoding const &other) const
+namespace
 {
-    static thread_local std::mt19937 rng(std::random_device{}());
-
-    size_t rows = dna.size();
-    size_t cols = dna[0].size();
-
-    // Step 1: Categorize requests
-    std::vector<int> both_parents;    // Delivered by both parents
-    std::vector<int> one_parent_only; // Delivered by exactly one parent
-
-    for (size_t col = 0; col < cols; col++)
+    // Clears bits of mask at random until keep of them are left.
+    template <typename Rng>
+    void keep_random_bits(std::vector<uint64_t> &mask, int keep, Rng &rng)
     {
-        bool in_this = false;
-        bool in_other = false;
-        int row_this = -1, row_other = -1;
-
-        // Check if request is delivered in this parent
-        for (size_t row = 0; row < rows; row++)
+        std::vector<int> indices;
+        for (int w = 0; w < (int)mask.size(); w++)
         {
-            if (dna[row][col])
-            {
-                in_this = true;
-                row_this = row;
-                break;
-            }
+            for (uint64_t word = mask[w]; word; word &= word - 1)
+                indices.push_back(w * 64 + std::countr_zero(word));
         }
-
-        // Check if request is delivered in other parent
-        for (size_t row = 0; row < rows; row++)
+        if (keep >= (int)indices.size())
+            return;
+        // Partial Fisher-Yates, the first keep indices are a uniform sample.
+        for (int i = 0; i < keep; i++)
         {
-            if (other.dna[row][col])
-            {
-                in_other = true;
-                row_other = row;
-                break;
-            }
+            std::uniform_int_distribution<int> pick(i, (int)indices.size() - 1);
+            std::swap(indices[i], indices[pick(rng)]);
         }
+        std::fill(mask.begin(), mask.end(), 0);
+        for (int i = 0; i < keep; i++)
+            mask[indices[i] / 64] |= uint64_t{1} << (indices[i] % 64);
+    }
+}
 
-        if (in_this && in_other)
-        {
-            both_parents.push_back(col);
-        }
-        else if (in_this || in_other)
+Encoding Encoding::blend(Encoding const &other, std::vector<uint64_t> const &take_this, std::vector<uint64_t> const &take_other) const
+{
+    assert(num_vehicles == other.num_vehicles && num_requests == other.num_requests);
+    Encoding offspring(num_vehicles, num_requests);
+    bitwords::blend_rows(offspring.bits.data(), bits.data(), other.bits.data(),
+                         take_this.data(), take_other.data(), num_vehicles, num_words);
+
+    // Each request keeps the vehicle of the parent it was taken from. Branch free, since the
+    // masks are random.
+    for (int w = 0; w < num_words; w++)
+    {
+        offspring.served_bits[w] = take_this[w] | take_other[w];
+        int end = std::min(64, num_requests - w * 64);
+        for (int b = 0; b < end; b++)
         {
-            one_parent_only.push_back(col);
+            int request = w * 64 + b;
+            int16_t from_this = (take_this[w] >> b) & 1, from_other = (take_other[w] >> b) & 1;
+            offspring.vehicle_of_request[request] = (int16_t)(from_this * vehicle_of_request[request] +
+                                                              from_other * other.vehicle_of_request[request] +
+                                                              (1 - from_this - from_other) * -1);
         }
     }
+    offspring.served = (int)bitwords::popcount(offspring.served_bits.data(), num_words);
 
-    int needed = I.gamma - (int)both_parents.size();
-    std::shuffle(one_parent_only.begin(), one_parent_only.end(), rng);
-    std::shuffle(both_parents.begin(), both_parents.end(), rng);
+    offspring.inherit_routes(*this);
+    offspring.inherit_routes(other);
+    return offspring;
+}
 
-    if (needed < 0)
-    {
+Encoding Encoding::operator+(Encoding const &other) const
+{
+    return uniform_crossover(other, rng::thread_engine());
+}
 
-        both_parents = std::vector<int>(both_parents.begin(), both_parents.begin() + both_parents.size() + needed);
+Encoding Encoding::uniform_crossover(Encoding const &other, rng::Engine &rng) const
+{
+    assert(num_vehicles == other.num_vehicles && num_requests == other.num_requests);
+    // One coin per request, 64 at a time. The second offer wins on heads, or if this parent
+    // does not deliver the request at all.
+    std::vector<uint64_t> take_this(num_words), take_other(num_words);
+    for (int w = 0; w < num_words; w++)
+    {
+        uint64_t heads = rng();
+        take_other[w] = other.served_bits[w] & (heads | ~served_bits[w]);
+        take_this[w] = served_bits[w] & ~take_other[w];
     }
+    return blend(other, take_this, take_other);
+}
 
-    dna_t offspring(rows, std::vector<bool>(cols, false));
+Encoding Encoding::add(Instance const &I, Encoding const &other, rng::Engine *engine) const
+{
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
 
-    // Add requests from both parents (inherit vehicle assignment randomly)
-    for (int col : both_parents)
+    // Step 1: Categorize requests, delivered by both parents or by exactly one of them
+    std::vector<uint64_t> both_parents(num_words), one_parent_only(num_words);
+    for (int w = 0; w < num_words; w++)
     {
-        int row_this = -1, row_other = -1;
-
-        for (size_t row = 0; row < rows; row++)
-        {
-            if (dna[row][col])
-                row_this = row;
-            if (other.dna[row][col])
-                row_other = row;
-        }
-
-        // Randomly choose which parent's vehicle assignment to use
-        std::uniform_int_distribution<int> coin(0, 1);
-        int chosen_row = (coin(rng) == 0) ? row_this : row_other;
-        offspring[chosen_row][col] = true;
+        both_parents[w] = served_bits[w] & other.served_bits[w];
+        one_parent_only[w] = served_bits[w] ^ other.served_bits[w];
     }
 
-    // Add randomly selected requests from one_parent_only
-    for (int i = 0; i < needed; i++)
+    int num_both = (int)bitwords::popcount(both_parents.data(), num_words);
+    int needed = I.gamma - num_both;
+    if (needed < 0)
     {
-        int col = one_parent_only[i];
-
-        // Find which parent has this request and which vehicle
-        for (size_t row = 0; row < rows; row++)
-        {
-            if (dna[row][col] || other.dna[row][col])
-            {
-                offspring[row][col] = true;
-                break;
-            }
-        }
+        keep_random_bits(both_parents, I.gamma, rng);
+        needed = 0;
     }
+    // Add randomly selected requests from one_parent_only
+    keep_random_bits(one_parent_only, needed, rng);
 
-    return {std::move(offspring)};
+    // Requests of both parents inherit the vehicle of a random parent, the others the vehicle
+    // of the parent that delivers them.
+    std::vector<uint64_t> take_this(num_words), take_other(num_words);
+    for (int w = 0; w < num_words; w++)
+    {
+        uint64_t heads = rng();
+        take_this[w] = (both_parents[w] & heads) | (one_parent_only[w] & served_bits[w]);
+        take_other[w] = (both_parents[w] & ~heads) | (one_parent_only[w] & other.served_bits[w]);
+    }
+    return blend(other, take_this, take_other);
 }
 
 std::vector<int> Encoding::get_requests_of_route(int route) const
 {
-    size_t rows = dna.size();
-    assert(route < rows);
-    size_t cols = dna[0].size();
+    assert(route < num_vehicles);
 
     std::vector<int> requests;
-    requests.reserve(cols);
-    for (size_t col = 0; col < cols; col++)
+    uint64_t const *row = &bits[(size_t)route * num_words];
+    for (int w = 0; w < num_words; w++)
     {
-        if (dna[route][col])
-            requests.push_back((int)col);
+        for (uint64_t word = row[w]; word; word &= word - 1)
+            requests.push_back(w * 64 + std::countr_zero(word));
     }
-
     return requests;
 }
 
-Encoding::dna_t const &Encoding::get_dna() const
+Encoding::dna_t Encoding::get_dna() const
 {
+    dna_t dna(num_vehicles, std::vector<bool>(num_requests, false));
+    for (int request = 0; request < num_requests; request++)
+    {
+        if (vehicle_of_request[request] != -1)
+            dna[vehicle_of_request[request]][request] = true;
+    }
     return dna;
 }
 Encoding::dna_t Encoding::get_dna_copy() const
 {
-    return dna;
+    return get_dna();
 }
 
 std::vector<int> Encoding::get_non_delivered_requests() const{
-    size_t rows = dna.size();
-    size_t cols = dna[0].size();
-
     std::vector<int> non_delivered;
-
-    for(size_t col =0; col<cols;++col){
-        bool is_delivered = false;
-        for(size_t row = 0; row<rows; row++){
-            if(dna[row][col]){
-                is_delivered=true;
+    non_delivered.reserve(num_requests - served);
+    for (int w = 0; w < num_words; w++)
+    {
+        for (uint64_t word = ~served_bits[w]; word; word &= word - 1)
+        {
+            int request = w * 64 + std::countr_zero(word);
+            if (request >= num_requests)
                 break;
-            }
+            non_delivered.push_back(request);
         }
-
-        if(is_delivered)
-            continue;
-        
-        non_delivered.push_back((int)col);
-
-
     }
-
     return non_delivered;
 }
 
 int Encoding::get_num_vehicles() const{
-    return dna.size();
+    return num_vehicles;
 }
 int Encoding::get_num_requests() const{
-    return dna[0].size();
-}
\ No newline at end of file
+    return num_requests;
+}
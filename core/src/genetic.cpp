@@ -1,41 +1,47 @@
+#include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <iostream>
 #include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <unordered_set>
 #include "structures.hpp"
 #include "solvers.hpp"
+#include "construction_cache.hpp"
+#include "thread_pool.hpp"
 
 std::vector<Encoding> GA::generate_initial_population(Instance const &I, int k1)
 {
-    std::vector<Encoding> tortn;
-    tortn.reserve(k1);
-
     if (k1 < 3)
     {
         std::cout << " I need a population of more than 3 to operate. \n";
         std::abort();
     }
 
+    // A third DC with k-means seeds 0, 1, ..., the rest beam search with alpha spread over
+    // [0.6, 1], starting with the tuned 0.9. Every seed is a different construction, and all of
+    // them are memoized per instance, so later runs on the same instance only copy them.
     size_t size_of_dc = (size_t)k1 / 3;
-    size_t counter = 0;
+    size_t size_of_bs = (size_t)k1 - size_of_dc;
+    auto bs_alpha = [&](size_t j)
+    { return j == 0 ? 0.9 : 0.6 + 0.4 * (double)(j - 1) / std::max<size_t>(1, size_of_bs - 2); };
 
-    for (; counter < size_of_dc; counter++)
-    {
-        // Solution tmp = BS::beam_search(I, 0.9, 5);
+    auto seeds = parallel_map<Solution>(k1, [&](size_t i)
+                                        {
+        if (i < size_of_dc)
+            return ConstructionCache::global().dc(I, (unsigned)i);
+        return ConstructionCache::global().beam_search(I, bs_alpha(i - size_of_dc), 5); });
 
-        Solution tmp = DC::construction(I);
-        Encoding encoding(I, tmp);
-        tortn.push_back(std::move(encoding));
-    }
-    for (; counter < k1; counter++)
-    {
-        Solution tmp = BS::beam_search(I, 0.9, 5);
-        Encoding encoding(I, tmp);
-        tortn.push_back(std::move(encoding));
-    }
+    std::vector<Encoding> tortn;
+    tortn.reserve(k1);
+    for (auto const &sol : seeds)
+        tortn.emplace_back(I, sol);
     return tortn;
 }
 
-std::vector<Encoding> GA::reproduce(Instance const &I, std::vector<Encoding> const &parents)
+std::vector<Encoding> GA::reproduce(Instance const &I, std::vector<Encoding> const &parents, rng::Engine *engine)
 {
     std::vector<Encoding> tortn;
     tortn.reserve((parents.size() * (parents.size() - 1)) / 2);
@@ -45,7 +51,7 @@ std::vector<Encoding> GA::reproduce(Instance const &I, std::vector<Encoding> con
         for (size_t j = i + 1; j < parents.size(); j++)
         {
 
-            Encoding new_encoding = parents[i].add(I, parents[j]);
+            Encoding new_encoding = parents[i].add(I, parents[j], engine);
             // assert(new_encoding.total_num_of_requests()==I.gamma);
             if (new_encoding.total_num_of_requests() != I.gamma)
             {
@@ -59,11 +65,15 @@ std::vector<Encoding> GA::reproduce(Instance const &I, std::vector<Encoding> con
 }
 
 void GA::mutate(Instance const &I, std::vector<Encoding> &population, int k2)
+{
+    mutate(I, population, k2, rng::thread_engine());
+}
+
+void GA::mutate(Instance const &I, std::vector<Encoding> &population, int k2, rng::Engine &gen)
 {
     if (k2 == 0)
         return;
 
-    static thread_local std::mt19937 gen(std::random_device{}());
     std::uniform_int_distribution<int> request_dist(0, I.n - 1);
     std::uniform_int_distribution<int> vehicle_dist(0, I.nK - 1);
 
@@ -77,70 +87,83 @@ void GA::mutate(Instance const &I, std::vector<Encoding> &population, int k2)
         }
     }
 }
-std::vector<int> GA::select_indices_next_generation(Instance const &I, std::vector<Encoding> const &population, int k1, int beam_width)
+std::vector<double> GA::evaluate_population(Instance const &I, std::vector<Encoding> const &population, int beam_width, CancellationToken const *cancel)
 {
-    // std::vector<double> objectives(population.size());
-    std::vector<double> objectives;
-    objectives.reserve(population.size());
+    return parallel_map<double>(population.size(), [&](size_t i)
+                                { return utils::objective(I, population[i].to_sol(I, beam_width, cancel)); });
+}
 
-    for(auto const& enc: population){
-        Solution tmp = enc.to_sol(I, beam_width);
-        objectives.push_back(utils::objective(I, tmp));
-    }
+std::vector<int> GA::select_indices_next_generation(std::vector<double> const &objectives, int k1)
+{
     auto indices = numerical::argsort(objectives);
     return std::vector<int>(indices.begin(), indices.begin()+k1);
 }
 
-GA::BestSolution GA::get_best_solution(Instance const &I, std::vector<Encoding> const& encodings, int beam_width)
+std::vector<int> GA::select_indices_next_generation(Instance const &I, std::vector<Encoding> const &population, int k1, int beam_width, CancellationToken const *cancel)
 {
-    Solution sol;
-    double objective = std::numeric_limits<double>::infinity();
+    return select_indices_next_generation(evaluate_population(I, population, beam_width, cancel), k1);
+}
+
+GA::BestSolution GA::get_best_solution(Instance const &I, std::vector<Encoding> const &encodings, std::vector<double> const &objectives, int beam_width, CancellationToken const *cancel)
+{
+    assert(encodings.size() == objectives.size() && !encodings.empty());
+    size_t best = std::min_element(objectives.begin(), objectives.end()) - objectives.begin();
     BestSolution best_sol;
+    // Usually cached by the evaluation, but after a cancelled one the routes may be decoded
+    // differently, so the objective is taken from the returned solution.
+    best_sol.sol = encodings[best].to_sol(I, beam_width, cancel);
+    best_sol.objective = utils::objective(I, best_sol.sol);
+    return best_sol;
+}
+
+GA::BestSolution GA::get_best_solution(Instance const &I, std::vector<Encoding> const& encodings, int beam_width, CancellationToken const *cancel)
+{
+    return get_best_solution(I, encodings, evaluate_population(I, encodings, beam_width, cancel), beam_width, cancel);
+}
+
+void GA::next_generation(Instance const &I, std::vector<Encoding> &population, std::vector<double> &objectives, int k1, int k2, int beam_width, rng::Engine &rng, CancellationToken const *cancel)
+{
+    assert(population.size() == k1);
+    auto offsprings = reproduce(I, population, &rng);
+    assert(offsprings.size() >= k1);
+    mutate(I, offsprings, k2, rng);
+    auto offspring_objectives = evaluate_population(I, offsprings, beam_width, cancel);
+    auto indices_of_survivors = select_indices_next_generation(offspring_objectives, k1);
 
-    for (size_t i = 0; i < encodings.size(); i++)
+    population.clear();
+    objectives.clear();
+    for (size_t i = 0; i < k1; i++)
     {
-        Solution tmp = encodings[i].to_sol(I, beam_width);
-        double obj = utils::objective(I, tmp);
-        if (obj < objective)
-        {
-            sol = tmp;
-            objective = obj;
-        }
+        population.push_back(std::move(offsprings[indices_of_survivors[i]]));
+        objectives.push_back(offspring_objectives[indices_of_survivors[i]]);
     }
-    best_sol.objective = objective;
-    best_sol.sol = sol;
-    return best_sol;
 }
 
-Solution GA::genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, std::vector<double>* objectives_over_time )
+Solution GA::genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, std::vector<double>* objectives_over_time, CancellationToken const *cancel, IncumbentObserver *observer, rng::Engine *engine)
 {
+    RunClock clock;
     assert(beam_width > 0);
     assert(iters > 0);
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
     auto population = generate_initial_population(I, k1);
-    BestSolution best_sol = get_best_solution(I, population, beam_width);
+    auto objectives = evaluate_population(I, population, beam_width);
+    BestSolution best_sol = get_best_solution(I, population, objectives, beam_width);
+    notify_incumbent(observer, clock, 0, best_sol.objective, best_sol.sol);
 
     for (size_t iter = 0; iter < iters; iter++)
     {
-        assert(population.size() == k1);
-        auto offsprings = reproduce(I, population);
-        assert(offsprings.size() >= k1);
-        mutate(I, offsprings, k2);
-        auto indices_of_survivors = select_indices_next_generation(I, offsprings, k1, beam_width);
-        std::vector<Encoding> new_population;
-        new_population.reserve(k1);
-        for (size_t i = 0; i < k1; i++)
-        {
-            new_population.push_back(std::move(offsprings[indices_of_survivors[i]]));
-        }
-        BestSolution new_best_sol = get_best_solution(I, new_population, beam_width);
+        if (cancel && cancel->is_cancelled())
+            break;
+
+        next_generation(I, population, objectives, k1, k2, beam_width, rng, cancel);
+        BestSolution new_best_sol = get_best_solution(I, population, objectives, beam_width, cancel);
 
         if (new_best_sol.objective < best_sol.objective)
         {
             best_sol = std::move(new_best_sol);
+            notify_incumbent(observer, clock, iter + 1, best_sol.objective, best_sol.sol);
         }
 
-        std::swap(population, new_population); // Delete the older data
-
         if(objectives_over_time){
             (*objectives_over_time).push_back(best_sol.objective);
         }
@@ -148,3 +171,268 @@ Solution GA::genetic_algorithm(Instance const &I, int k1, int k2, int iters, int
     assert(best_sol.sol.is_solution_feasible(I));
     return best_sol.sol;
 }
+
+namespace
+{
+    // Best encodings of one island on their way to the next one on the ring.
+    struct Migrants
+    {
+        std::vector<Encoding> population;
+        std::vector<double> objectives; // best first
+    };
+
+    // One slot between neighbours on the ring. The sender swaps in its latest migrants, dropping
+    // any the receiver has not taken yet, and the receiver swaps in nullptr. Each side is one
+    // atomic exchange, so neither ever waits for the other.
+    class Mailbox
+    {
+        std::atomic<Migrants *> slot{nullptr};
+
+    public:
+        ~Mailbox() { delete slot.load(); }
+        void send(std::unique_ptr<Migrants> migrants)
+        {
+            delete slot.exchange(migrants.release(), std::memory_order_acq_rel);
+        }
+        std::unique_ptr<Migrants> receive()
+        {
+            return std::unique_ptr<Migrants>(slot.exchange(nullptr, std::memory_order_acq_rel));
+        }
+    };
+
+    // Indices of the count best (smallest) objectives, best first, or of the count worst, worst first.
+    std::vector<size_t> extreme_indices(std::vector<double> const &objectives, size_t count, bool best)
+    {
+        std::vector<size_t> order(objectives.size());
+        std::iota(order.begin(), order.end(), 0);
+        count = std::min(count, order.size());
+        std::partial_sort(order.begin(), order.begin() + count, order.end(), [&](size_t a, size_t b)
+                          { return best ? objectives[a] < objectives[b] : objectives[a] > objectives[b]; });
+        order.resize(count);
+        return order;
+    }
+}
+
+Solution GA::island_genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, IslandParams const &params, std::vector<double> *objectives_over_time, CancellationToken const *cancel, IncumbentObserver *observer, std::vector<IslandReport> *reports, rng::Engine *engine)
+{
+    RunClock clock;
+    assert(beam_width > 0);
+    assert(iters > 0);
+    int num_islands = params.islands > 0 ? params.islands : (int)ThreadPool::global().num_workers() + 1;
+    int interval = std::max(1, params.migration_interval);
+    int migrants = std::clamp(params.migrants, 0, k1 - 1);
+
+    struct Island
+    {
+        rng::Engine rng;
+        std::vector<Encoding> population;
+        std::vector<double> objectives;
+        BestSolution best;
+        IslandReport report;
+    };
+
+    // Every island starts from the same constructions, shaken by k2 mutations with its own
+    // stream so that they do not all search the same region. Island 0 keeps them unchanged.
+    rng::Engine &parent = engine ? *engine : rng::thread_engine();
+    auto initial = generate_initial_population(I, k1);
+    std::vector<Island> islands;
+    islands.reserve(num_islands);
+    for (int i = 0; i < num_islands; i++)
+    {
+        islands.push_back(Island{parent.split(i), initial, {}, {}, {}});
+        if (i > 0)
+            mutate(I, islands[i].population, k2, islands[i].rng);
+        islands[i].report.island = i;
+    }
+    ThreadPool::global().parallel_for(num_islands, [&](size_t i)
+                                      {
+        auto &island = islands[i];
+        island.objectives = evaluate_population(I, island.population, beam_width);
+        island.best = get_best_solution(I, island.population, island.objectives, beam_width); });
+
+    std::mutex best_mutex; // guards best_sol and the observer
+    BestSolution best_sol = std::min_element(islands.begin(), islands.end(), [](Island const &a, Island const &b)
+                                             { return a.best.objective < b.best.objective; })
+                                ->best;
+    notify_incumbent(observer, clock, 0, best_sol.objective, best_sol.sol);
+
+    // Islands run without synchronising: every interval generations an island posts its best
+    // migrants to the next one and takes whatever the previous one posted last, if anything,
+    // in place of its worst encodings. A slow island delays no one; it just sends less often.
+    std::vector<Mailbox> mailboxes(num_islands); // mailboxes[i] goes from island i to i + 1
+    ThreadPool::global().parallel_for(num_islands, [&](size_t i)
+                                      {
+        auto &island = islands[i];
+        for (int g = 0; g < iters; g++)
+        {
+            if (cancel && cancel->is_cancelled())
+                break;
+            next_generation(I, island.population, island.objectives, k1, k2, beam_width, island.rng, cancel);
+            auto new_best = get_best_solution(I, island.population, island.objectives, beam_width, cancel);
+            if (new_best.objective < island.best.objective)
+            {
+                island.best = std::move(new_best);
+                std::lock_guard<std::mutex> lock(best_mutex);
+                if (island.best.objective < best_sol.objective)
+                {
+                    best_sol = island.best;
+                    notify_incumbent(observer, clock, g + 1, best_sol.objective, best_sol.sol);
+                }
+            }
+            island.report.generations++;
+            island.report.best_over_time.push_back(island.best.objective);
+
+            if (num_islands == 1 || migrants == 0 || (g + 1) % interval != 0 || g + 1 == iters)
+                continue;
+
+            auto outgoing = std::make_unique<Migrants>();
+            for (size_t idx : extreme_indices(island.objectives, migrants, true))
+            {
+                outgoing->population.push_back(island.population[idx]);
+                outgoing->objectives.push_back(island.objectives[idx]);
+            }
+            mailboxes[i].send(std::move(outgoing));
+
+            auto incoming = mailboxes[(i + num_islands - 1) % num_islands].receive();
+            if (!incoming)
+                continue;
+            // Best migrant against worst member, second best against second worst, ...
+            auto victims = extreme_indices(island.objectives, incoming->objectives.size(), false);
+            for (size_t m = 0; m < victims.size(); m++)
+            {
+                if (incoming->objectives[m] >= island.objectives[victims[m]])
+                    break;
+                island.population[victims[m]] = std::move(incoming->population[m]);
+                island.objectives[victims[m]] = incoming->objectives[m];
+                island.report.immigrants_accepted++;
+            }
+        } });
+
+    if (objectives_over_time)
+    {
+        // Islands stopped by cancel hold fewer entries, their last one stands in.
+        size_t generations = 0;
+        for (auto const &island : islands)
+            generations = std::max(generations, island.report.best_over_time.size());
+        for (size_t g = 0; g < generations; g++)
+        {
+            double best_in_generation = std::numeric_limits<double>::infinity();
+            for (auto const &island : islands)
+            {
+                auto const &history = island.report.best_over_time;
+                if (!history.empty())
+                    best_in_generation = std::min(best_in_generation, history[std::min(g, history.size() - 1)]);
+            }
+            objectives_over_time->push_back(best_in_generation);
+        }
+    }
+
+    if (reports)
+    {
+        reports->clear();
+        for (auto &island : islands)
+        {
+            island.report.best_objective = island.best.objective;
+            reports->push_back(std::move(island.report));
+        }
+    }
+    assert(best_sol.sol.is_solution_feasible(I));
+    return best_sol.sol;
+}
+
+Solution GA::steady_state_genetic_algorithm(Instance const &I, int k1, int k2, int iters, int beam_width, int offspring, int tournament, std::vector<double> *objectives_over_time, CancellationToken const *cancel, IncumbentObserver *observer, rng::Engine *engine)
+{
+    RunClock clock;
+    assert(beam_width > 0);
+    assert(iters > 0);
+    assert(offspring > 0);
+    if (k1 < 2)
+    {
+        // Children need two distinct parents.
+        std::cerr << "ERROR: steady state GA needs a population of at least 2, got " << k1 << std::endl;
+        std::abort();
+    }
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
+    std::uniform_int_distribution<int> member(0, k1 - 1);
+
+    // Close beam search alphas can select the same requests, so the initial population may
+    // repeat encodings. Copies are mutated until they are new, or left as they are after a few tries.
+    auto population = generate_initial_population(I, k1);
+    std::unordered_multiset<uint64_t> hashes;
+    for (auto &encoding : population)
+    {
+        std::vector<Encoding> single{std::move(encoding)};
+        for (int attempt = 0; attempt < 10 && hashes.count(single[0].hash()); attempt++)
+            mutate(I, single, std::max(1, k2), rng);
+        encoding = std::move(single[0]);
+        hashes.insert(encoding.hash());
+    }
+    auto objectives = evaluate_population(I, population, beam_width);
+    BestSolution best_sol = get_best_solution(I, population, objectives, beam_width);
+    notify_incumbent(observer, clock, 0, best_sol.objective, best_sol.sol);
+
+    auto select_parent = [&]()
+    {
+        int winner = member(rng);
+        for (int t = 1; t < tournament; t++)
+        {
+            int challenger = member(rng);
+            if (objectives[challenger] < objectives[winner])
+                winner = challenger;
+        }
+        return winner;
+    };
+
+    for (size_t iter = 0; iter < iters; iter++)
+    {
+        if (cancel && cancel->is_cancelled())
+            break;
+
+        // A bounded number of children per generation, so the cost is linear in offspring and
+        // not quadratic in k1. Children already in the population are not decoded at all.
+        std::vector<Encoding> children;
+        std::unordered_set<uint64_t> child_hashes;
+        for (int attempt = 0; (int)children.size() < offspring && attempt < 2 * offspring; attempt++)
+        {
+            int a = select_parent(), b = select_parent();
+            if (a == b)
+                continue;
+            std::vector<Encoding> child{population[a].add(I, population[b], &rng)};
+            mutate(I, child, k2, rng);
+            uint64_t h = child[0].hash();
+            if (hashes.count(h) || !child_hashes.insert(h).second)
+                continue;
+            children.push_back(std::move(child[0]));
+        }
+        auto child_objectives = evaluate_population(I, children, beam_width, cancel);
+        // Children decoded after the cancellation are only greedy and not cached; keep none of them.
+        if (cancel && cancel->is_cancelled())
+            break;
+
+        // Each child replaces the current worst member if it is better.
+        for (auto c : numerical::argsort(child_objectives))
+        {
+            int worst = (int)(std::max_element(objectives.begin(), objectives.end()) - objectives.begin());
+            if (child_objectives[c] >= objectives[worst])
+                break;
+            hashes.erase(hashes.find(population[worst].hash()));
+            hashes.insert(children[c].hash());
+            population[worst] = std::move(children[c]);
+            objectives[worst] = child_objectives[c];
+
+            if (objectives[worst] < best_sol.objective)
+            {
+                // Cached by the evaluation, which finished before any cancellation. The
+                // objective still comes from the returned routes.
+                best_sol.sol = population[worst].to_sol(I, beam_width, cancel);
+                best_sol.objective = utils::objective(I, best_sol.sol);
+                notify_incumbent(observer, clock, iter + 1, best_sol.objective, best_sol.sol);
+            }
+        }
+
+        if (objectives_over_time)
+            objectives_over_time->push_back(best_sol.objective);
+    }
+    assert(best_sol.sol.is_solution_feasible(I));
+    return best_sol.sol;
+}
@@ -1,132 +1,350 @@
 #include <vector>
 #include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cmath>
 #include <random>
 #include <functional>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <mutex>
+#include <string>
 #include "solvers.hpp"
 #include "structures.hpp"
+#include "thread_pool.hpp"
 
-
-Solution GRASP::randomized_constructor_simple(
-    const Instance &I,
-    double a,
-    double alpha)
+namespace
 {
-    const int n  = I.n;
-    const int nK = I.nK;
-    const int max_tries = 100;
-
-    // heuristic costs
-    std::vector<double> costs = utils::calc_my_metric(I, a);
-
-    // argsort(costs)
-    std::vector<int> perm(n);
-    std::iota(perm.begin(), perm.end(), 0);
-    std::sort(perm.begin(), perm.end(),
-              [&](int i, int j) { return costs[i] < costs[j]; });
+    // Local search iterations between two points of a restart profile, and points kept.
+    constexpr int PROFILE_STEP = 50;
+    constexpr size_t PROFILE_POINTS = 64;
+
+    /**
+     * Best objective any restart of one neighborhood had after PROFILE_STEP, 2 PROFILE_STEP, ...
+     * local search iterations (the last point covers everything after it). Constructions are
+     * not compared, they say little about where the search ends. Updated and read without
+     * locking.
+     */
+    using Profile = std::vector<std::atomic<double>>;
+
+    // Stops a local search that is more than margin (relative) behind the profile at the same depth.
+    class BehindProfile : public StoppingCriterion
+    {
+        Profile &profile;
+        double margin;
 
-    Solution sol;
-    sol.routes.assign(nK, std::vector<int>{});
+    public:
+        BehindProfile(Profile &profile_, double margin_)
+            : profile(profile_), margin(margin_) {}
 
-    int served = 0;
-    std::vector<bool> used(n, false);
+        inline void reset() override {}
+        inline bool operator()(int iteration, double f) override
+        {
+            if (iteration == 0 || iteration % PROFILE_STEP != 0)
+                return false;
+            auto &point = profile[std::min<size_t>(iteration / PROFILE_STEP - 1, profile.size() - 1)];
+            double leader = point.load(std::memory_order_relaxed);
+            while (f < leader && !point.compare_exchange_weak(leader, f, std::memory_order_relaxed))
+                ;
+            return f > leader * (1.0 + margin);
+        }
+    };
+}
 
-    static thread_local std::mt19937 rng(std::random_device{}());
 
-    while (served < I.gamma)
+namespace
+{
+    /**
+     * Feasible insertions of one request into one route: pickup before stop ip, delivery before
+     * stop jp, ip <= jp <= route size. The pickup fits where the load before ip leaves room
+     * for the demand, and the delivery may go anywhere up to the first later stop that would
+     * then be overloaded, so every feasible pair comes out of one backward pass over the loads.
+     *
+     * With temperature > 0 the weights are summed in log space, over a window of delivery
+     * positions that only moves forward with ip, and scaled so the heaviest ip has weight 1.
+     * However cold, the feasible pairs never all round to 0.
+     */
+    class InsertionSampler
     {
-        // remaining requests (not yet used)
-        std::vector<int> remaining;
-        remaining.reserve(n);
-        for (int r : perm)
-            if (!used[r])
-                remaining.push_back(r);
-
-        if (remaining.empty())
-            break;
+        Instance const &I;
+        double temperature;
+        std::vector<int> loads;             // after each stop
+        std::vector<int> reach;             // last feasible jp for each ip
+        std::vector<double> delivery;       // cost of the delivery before jp
+        std::vector<double> window;         // suffix log sums of the delivery weights
+        std::vector<double> adjacent_share; // of the weight of ip on the pair (ip, ip)
+        std::vector<double> ip_weights;     // of all pairs starting at ip
+
+        bool fits(int ip, int demand) const { return (ip > 0 ? loads[ip - 1] : 0) + demand <= I.C; }
+
+    public:
+        InsertionSampler(Instance const &I_, double temperature_)
+            : I(I_), temperature(temperature_) {}
+
+        // Total weight of the feasible pairs of route, 0 if there are none.
+        double evaluate(std::vector<int> const &route, int req);
+        // One pair drawn in proportion to its weight. evaluate(route, req) has to come first.
+        std::pair<int, int> sample(std::vector<int> const &route, double total, rng::Engine &rng) const;
+    };
+
+    // log(exp(a) + exp(b))
+    double log_add(double a, double b)
+    {
+        if (a < b)
+            std::swap(a, b);
+        if (b == -std::numeric_limits<double>::infinity())
+            return a;
+        return a + std::log1p(std::exp(b - a));
+    }
 
-        int k = std::max(1, int(alpha * remaining.size()));
-        if (k > (int)remaining.size())
-            k = (int)remaining.size();
+    double InsertionSampler::evaluate(std::vector<int> const &route, int req)
+    {
+        int m = (int)route.size();
+        int p = 1 + req;
+        int d = 1 + I.n + req;
+        int demand = I.demands[req];
+        auto const &dist = I.dist;
+        auto stop = [&](int i)
+        { return i >= 0 && i < m ? route[i] : 0; };
+
+        loads.resize(m);
+        int load = 0;
+        for (int i = 0; i < m; i++)
+        {
+            load += I.load_change[route[i]];
+            loads[i] = load;
+        }
 
-        std::uniform_int_distribution<int> pick_rcl(0, k - 1);
-        int req = remaining[pick_rcl(rng)];
-        used[req] = true;
+        reach.resize(m + 1);
+        reach[m] = m;
+        for (int i = m - 1; i >= 0; i--)
+            reach[i] = loads[i] + demand > I.C ? i : reach[i + 1];
 
-        int pickup = 1 + req;
-        int drop   = 1 + I.n + req;
-        int dem    = I.demands[req];
+        ip_weights.assign(m + 1, 0.0);
+        adjacent_share.assign(m + 1, 0.0);
 
-        bool inserted = false;
+        // Uniform: ip carries its adjacent pair and one pair per delivery position in (ip, reach[ip]].
+        if (temperature <= 0.0)
+        {
+            double total = 0.0;
+            for (int ip = 0; ip <= m; ip++)
+            {
+                if (!fits(ip, demand))
+                    continue;
+                ip_weights[ip] = 1.0 + (reach[ip] - ip);
+                adjacent_share[ip] = 1.0 / ip_weights[ip];
+                total += ip_weights[ip];
+            }
+            return total;
+        }
 
-        for (int t = 0; t < max_tries; ++t)
+        delivery.resize(m + 1);
+        for (int jp = 0; jp <= m; jp++)
+            delivery[jp] = dist[stop(jp - 1)][d] + dist[d][stop(jp)] - dist[stop(jp - 1)][stop(jp)];
+
+        // Log sum of the delivery weights over [ip + 1, reach[ip]]. Both ends only move forward:
+        // positions [lo, mid) hold suffix sums in window, [mid, hi] are summed into back. Once lo
+        // passes mid, [lo, hi] becomes the new front, so each position is summed at most twice.
+        double const neg_inf = -std::numeric_limits<double>::infinity();
+        window.resize(m + 1);
+        int lo = 0, mid = 0, hi = -1;
+        double back = neg_inf;
+        double heaviest = neg_inf;
+        for (int ip = 0; ip <= m; ip++)
         {
-            std::uniform_int_distribution<int> pick_route(0, nK - 1);
-            int vk = pick_route(rng);
-            auto &route = sol.routes[vk];
-            int m = (int)route.size();
+            if (!fits(ip, demand))
+                continue;
 
-            // handle empty route explicitly
-            if (m == 0)
+            lo = ip + 1;
+            if (lo > hi)
             {
-                if (dem <= I.C) {
-                    route.push_back(pickup);
-                    route.push_back(drop);
-                    inserted = true;
-                    served++;
-                    break;
-                }
-                // cannot serve on empty vehicle (capacity too small), try another vehicle/attempt
-                continue;
+                mid = lo;
+                hi = lo - 1;
+                back = neg_inf;
+            }
+            for (; hi < reach[ip]; hi++)
+                back = log_add(back, -delivery[hi + 1] / temperature);
+            if (lo > mid)
+            {
+                double sum = neg_inf;
+                for (int jp = hi; jp >= lo; jp--)
+                    window[jp] = sum = log_add(sum, -delivery[jp] / temperature);
+                mid = hi + 1;
+                back = neg_inf;
             }
+            double deliveries = log_add(lo < mid ? window[lo] : neg_inf, back);
+
+            int prev = stop(ip - 1);
+            int next = stop(ip);
+            double pickup = dist[prev][p] + dist[p][next] - dist[prev][next];
+            double adjacent = -(dist[prev][p] + dist[p][d] + dist[d][next] - dist[prev][next]) / temperature;
+            double log_weight = log_add(adjacent, deliveries - pickup / temperature);
+            adjacent_share[ip] = std::exp(adjacent - log_weight);
+            ip_weights[ip] = log_weight;
+            heaviest = std::max(heaviest, log_weight);
+        }
+
+        double total = 0.0;
+        for (int ip = 0; ip <= m; ip++)
+        {
+            if (!fits(ip, demand))
+                continue;
+            ip_weights[ip] = std::exp(ip_weights[ip] - heaviest);
+            total += ip_weights[ip];
+        }
+        return total;
+    }
+
+    std::pair<int, int> InsertionSampler::sample(std::vector<int> const &route, double total, rng::Engine &rng) const
+    {
+        std::uniform_real_distribution<double> uni(0.0, 1.0);
+        int m = (int)route.size();
 
-            // non-empty route: choose ip, jp safely
-            // ip in [0, m-1], jp in [ip+1, m]
-            std::uniform_int_distribution<int> pick_ip(0, m - 1);
-            int ip = pick_ip(rng);
-
-            std::uniform_int_distribution<int> pick_jp(ip + 1, m);
-            int jp = pick_jp(rng);
-
-            // build candidate route:
-            std::vector<int> new_r;
-            new_r.reserve(m + 2);
-
-            // [0, ip)
-            new_r.insert(new_r.end(), route.begin(), route.begin() + ip);
-            // pickup
-            new_r.push_back(pickup);
-            // [ip, jp)
-            new_r.insert(new_r.end(), route.begin() + ip, route.begin() + jp);
-            // drop
-            new_r.push_back(drop);
-            // [jp, m)
-            new_r.insert(new_r.end(), route.begin() + jp, route.end());
-
-            auto cargo = utils::calc_route_cargo(I, new_r);
-            bool ok = true;
-            for (int c : cargo)
+        double target = uni(rng) * total;
+        int ip = 0;
+        for (; ip < m; ip++)
+        {
+            if (target < ip_weights[ip])
+                break;
+            target -= ip_weights[ip];
+        }
+        // Rounding may leave target past the last positive weight.
+        while (ip_weights[ip] == 0.0)
+            ip--;
+
+        if (reach[ip] == ip || uni(rng) < adjacent_share[ip])
+            return {ip, ip};
+        if (temperature <= 0.0)
+            return {ip, std::uniform_int_distribution<int>(ip + 1, reach[ip])(rng)};
+
+        // Delivery weights relative to the cheapest one of the window, which has weight 1.
+        double cheapest = *std::min_element(delivery.begin() + ip + 1, delivery.begin() + reach[ip] + 1);
+        auto weight = [&](int jp)
+        { return std::exp(-(delivery[jp] - cheapest) / temperature); };
+        double sum = 0.0;
+        for (int jp = ip + 1; jp <= reach[ip]; jp++)
+            sum += weight(jp);
+
+        target = uni(rng) * sum;
+        int jp = ip + 1;
+        for (; jp < reach[ip]; jp++)
+        {
+            double w = weight(jp);
+            if (target < w)
+                break;
+            target -= w;
+        }
+        return {ip, jp};
+    }
+}
+
+namespace
+{
+    // Requests in a fixed order; the one of rank k among those left is found and removed in
+    // O(log n) with a Fenwick tree over their positions.
+    class RankedRequests
+    {
+        std::vector<int> order;
+        std::vector<int> tree; // 1-based, counts the requests left
+        int left;
+
+    public:
+        explicit RankedRequests(std::vector<int> order_)
+            : order(std::move(order_)), tree(order.size() + 1, 0), left((int)order.size())
+        {
+            int n = (int)order.size();
+            for (int i = 1; i <= n; i++)
             {
-                if (c < 0 || c > I.C)
-                {
-                    ok = false;
-                    break;
-                }
+                tree[i]++;
+                int parent = i + (i & -i);
+                if (parent <= n)
+                    tree[parent] += tree[i];
             }
+        }
+
+        int size() const { return left; }
 
-            if (ok)
+        // Removes and returns the request of rank k, 0 being the first one left.
+        int take(int k)
+        {
+            int n = (int)order.size();
+            int pos = 0;
+            int rank = k + 1;
+            for (int step = std::bit_floor((unsigned)n); step > 0; step >>= 1)
             {
-                route = std::move(new_r);
-                inserted = true;
-                served++;
-                break;
+                if (pos + step <= n && tree[pos + step] < rank)
+                {
+                    pos += step;
+                    rank -= tree[pos];
+                }
             }
+            for (int i = pos + 1; i <= n; i += i & -i)
+                tree[i]--;
+            left--;
+            return order[pos];
         }
+    };
+}
 
-        // failed to insert this request in max_tries attempts → skip it
-        if (!inserted)
-            continue;
+Solution GRASP::randomized_constructor_simple(
+    const Instance &I,
+    double a,
+    double alpha,
+    double temperature,
+    rng::Engine *engine)
+{
+    const int n = I.n;
+    const int nK = I.nK;
+
+    // heuristic costs
+    std::vector<double> costs = utils::calc_my_metric(I, a);
+
+    // Requests not tried yet, cheapest first. The restricted candidate list is its front.
+    std::vector<int> order(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(),
+              [&](int i, int j)
+              { return costs[i] < costs[j]; });
+    RankedRequests remaining(std::move(order));
+
+    Solution sol;
+    sol.routes.assign(nK, std::vector<int>{});
+
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
+    InsertionSampler sampler(I, temperature);
+    std::vector<int> vehicles(nK);
+    std::iota(vehicles.begin(), vehicles.end(), 0);
+
+    int served = 0;
+    while (served < I.gamma && remaining.size() > 0)
+    {
+        int k = std::clamp(int(alpha * remaining.size()), 1, remaining.size());
+        std::uniform_int_distribution<int> pick_rcl(0, k - 1);
+        int req = remaining.take(pick_rcl(rng));
+
+        // Vehicles in random order, the first one with room takes the request.
+        std::shuffle(vehicles.begin(), vehicles.end(), rng);
+        for (int vk : vehicles)
+        {
+            auto &route = sol.routes[vk];
+            double total = sampler.evaluate(route, req);
+            if (total <= 0.0)
+                continue;
+
+            auto [ip, jp] = sampler.sample(route, total, rng);
+            route.insert(route.begin() + jp, 1 + n + req);
+            route.insert(route.begin() + ip, 1 + req);
+            served++;
+            break;
+        }
+        // A request no vehicle has room for is left out, the next candidates take its place.
     }
 
+    if (served < I.gamma)
+        throw ConstructionFailed("randomized construction served " + std::to_string(served) + " of " +
+                                 std::to_string(I.gamma) + " requests");
+    sol.compute_cached_values_from_routes(I);
     return sol;
 }
 
@@ -138,8 +356,11 @@ Solution GRASP::grasp(
     StepFunction::Func step_function,
     StoppingCriterion &stopping_outer,
     StoppingCriterion &stopping_local,
-    int *iteration_ptr)
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
 {
+    RunClock clock;
     Solution best_sol; // final result
     double best_f = std::numeric_limits<double>::infinity();
 
@@ -152,7 +373,16 @@ Solution GRASP::grasp(
     while (!stopping_outer(step, best_f))
     {
         // === construct a new initial solution ===
-        Solution sol0 = randomized_constructor(I);
+        Solution sol0;
+        try
+        {
+            sol0 = randomized_constructor(I);
+        }
+        catch (ConstructionFailed const &)
+        {
+            step++;
+            continue;
+        }
 
         stopping_local.reset();
         Solution sol1 = LS::local_search(
@@ -160,7 +390,10 @@ Solution GRASP::grasp(
             sol0,
             neighborhoods[step % neighborhoods.size()], // rotate neighborhood
             step_function,
-            stopping_local);
+            stopping_local,
+            nullptr,
+            nullptr,
+            engine);
 
         double f1 = utils::objective(I, sol1);
 
@@ -168,6 +401,7 @@ Solution GRASP::grasp(
         {
             best_f = f1;
             best_sol = sol1;
+            notify_incumbent(observer, clock, step, best_f, best_sol);
         }
 
         step++;
@@ -178,3 +412,97 @@ Solution GRASP::grasp(
 
     return best_sol;
 }
+
+Solution GRASP::parallel_grasp(
+    const Instance &I,
+    std::function<Solution(const Instance &, rng::Engine &)> randomized_constructor,
+    const Neighborhood::NeighborhoodFactories &neighborhoods,
+    StepFunction::Func step_function,
+    StoppingCriterion &stopping_outer,
+    std::function<std::shared_ptr<StoppingCriterion>()> make_stopping_local,
+    double abort_margin,
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
+{
+    RunClock clock;
+    rng::Engine &parent = engine ? *engine : rng::thread_engine();
+
+    std::atomic<double> best_f{std::numeric_limits<double>::infinity()};
+    std::vector<Profile> profiles(neighborhoods.size());
+    for (auto &profile : profiles)
+    {
+        profile = Profile(PROFILE_POINTS);
+        for (auto &point : profile)
+            point.store(std::numeric_limits<double>::infinity());
+    }
+    std::mutex best_mutex; // guards everything below
+    Solution best_sol;
+    int best_restart = -1;
+    int started = 0;
+    bool stopped = false;
+
+    stopping_outer.reset();
+
+    // One loop per thread, each claiming restarts until stopping_outer says no more.
+    ThreadPool &pool = ThreadPool::global();
+    pool.parallel_for(pool.num_workers() + 1, [&](size_t)
+                      {
+        while (true)
+        {
+            int restart;
+            {
+                std::lock_guard<std::mutex> lock(best_mutex);
+                stopped = stopped || stopping_outer(started, best_f.load());
+                if (stopped)
+                    return;
+                restart = started++;
+            }
+
+            rng::Engine rng = parent.split(restart);
+            Solution sol0;
+            try
+            {
+                sol0 = randomized_constructor(I, rng);
+            }
+            catch (ConstructionFailed const &)
+            {
+                continue;
+            }
+
+            size_t neighborhood = restart % neighborhoods.size(); // rotate neighborhood
+            auto local = make_stopping_local();
+            AnyCriterion stopping_local = std::isfinite(abort_margin)
+                                              ? AnyCriterion{local, std::make_shared<BehindProfile>(profiles[neighborhood], abort_margin)}
+                                              : AnyCriterion{local};
+            Solution sol1 = LS::local_search(
+                I,
+                sol0,
+                neighborhoods[neighborhood],
+                step_function,
+                stopping_local,
+                nullptr,
+                nullptr,
+                &rng);
+            double f1 = utils::objective(I, sol1);
+
+            // Most restarts lose, and find out without taking the lock.
+            if (f1 > best_f.load())
+                continue;
+
+            std::lock_guard<std::mutex> lock(best_mutex);
+            // Ties go to the lower restart, so the winner does not depend on finishing order.
+            if (f1 < best_f.load() || (f1 == best_f.load() && restart < best_restart))
+            {
+                best_sol = std::move(sol1);
+                best_restart = restart;
+                best_f.store(f1);
+                notify_incumbent(observer, clock, restart, f1, best_sol);
+            }
+        } });
+
+    if (iteration_ptr != nullptr)
+        *iteration_ptr = started;
+
+    return best_sol;
+}
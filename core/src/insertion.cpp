@@ -0,0 +1,123 @@
+#include <limits>
+#include "structures.hpp"
+
+namespace insertion
+{
+    std::vector<double> route_edges(Instance const &I, std::vector<int> const &route)
+    {
+        int const m = (int)route.size();
+        std::vector<double> edges(m + 1);
+        for (int idx = 0; idx <= m; idx++)
+        {
+            int a = idx > 0 ? route[idx - 1] : 0;
+            int b = idx < m ? route[idx] : 0;
+            edges[idx] = I.dist[a][b];
+        }
+        return edges;
+    }
+
+    PairInsertion cheapest_pair_insertion(
+        Instance const &I, std::vector<int> const &route, std::vector<int> const &cargo, int request)
+    {
+        return cheapest_pair_insertion(I, route, cargo, route_edges(I, route), request);
+    }
+
+    PairInsertion cheapest_pair_insertion(
+        Instance const &I, std::vector<int> const &route, std::vector<int> const &cargo,
+        std::vector<double> const &edges, int request)
+    {
+        int const m = (int)route.size();
+        int const p = 1 + request;
+        int const d = 1 + I.n + request;
+        int const dem = I.demands[request];
+        double const p_to_d = I.dist[p][d];
+
+        // to_p[j], to_d[j]: distance of p, d to the j-th node of depot, route..., depot. Gathered
+        // once so that the sweep below reads contiguous memory.
+        static thread_local std::vector<double> to_p, to_d, delivery_cost;
+        to_p.resize(m + 2);
+        to_d.resize(m + 2);
+        delivery_cost.resize(m + 1);
+        auto const &row_p = I.dist[p];
+        auto const &row_d = I.dist[d];
+        to_p[0] = to_p[m + 1] = row_p[0];
+        to_d[0] = to_d[m + 1] = row_d[0];
+        for (int j = 1; j <= m; j++)
+        {
+            to_p[j] = row_p[route[j - 1]];
+            to_d[j] = row_d[route[j - 1]];
+        }
+
+        PairInsertion best{std::numeric_limits<double>::infinity(), -1, -1};
+
+        // Delivery before jp (jp > ip) only depends on jp.
+        for (int jp = 1; jp <= m; jp++)
+            delivery_cost[jp] = to_d[jp] + to_d[jp + 1] - edges[jp];
+
+        // For pickup ip the delivery may go before any jp in (ip, end] where end is the first
+        // position whose load would exceed C with the request on board. end never decreases
+        // with ip, so the best delivery is a sliding window minimum.
+        static thread_local std::vector<int> window; // jp with increasing delivery_cost
+        window.resize(m + 1);
+        int front = 0, back = 0; // window[front, back)
+        int end = 0;
+        int pushed = 0;
+        for (int ip = 0; ip <= m; ip++)
+        {
+            int load_before = ip > 0 ? cargo[ip - 1] : 0;
+            if (end < ip)
+                end = ip;
+            while (end < m && cargo[end] + dem <= I.C)
+                end++;
+            if (load_before + dem > I.C)
+                continue;
+
+            // Both nodes next to each other.
+            double delta = to_p[ip] + p_to_d + to_d[ip + 1] - edges[ip];
+            if (delta < best.delta)
+                best = PairInsertion{delta, ip, ip};
+
+            while (pushed < end)
+            {
+                pushed++;
+                while (back > front && delivery_cost[window[back - 1]] >= delivery_cost[pushed])
+                    back--;
+                window[back++] = pushed;
+            }
+            while (back > front && window[front] <= ip)
+                front++;
+            if (back == front)
+                continue;
+
+            int jp = window[front];
+            delta = to_p[ip] + to_p[ip + 1] - edges[ip] + delivery_cost[jp];
+            if (delta < best.delta)
+                best = PairInsertion{delta, ip, jp};
+        }
+        return best;
+    }
+
+    void apply_pair_insertion(Instance const &I, std::vector<int> &route, int request, PairInsertion const &ins)
+    {
+        route.insert(route.begin() + ins.jp, 1 + I.n + request);
+        route.insert(route.begin() + ins.ip, 1 + request);
+    }
+
+    double pair_removal_delta(Instance const &I, std::vector<int> const &route, int p_idx, int d_idx)
+    {
+        int const m = (int)route.size();
+        auto const &dist = I.dist;
+        auto node = [&](int idx)
+        { return (idx < 0 || idx >= m) ? 0 : route[idx]; };
+
+        int p = route[p_idx], d = route[d_idx];
+        int prev = node(p_idx - 1), next = node(d_idx + 1);
+
+        if (d_idx == p_idx + 1)
+            return dist[prev][next] - dist[prev][p] - dist[p][d] - dist[d][next];
+
+        int after_p = route[p_idx + 1], before_d = route[d_idx - 1];
+        return dist[prev][after_p] - dist[prev][p] - dist[p][after_p] +
+               dist[before_d][next] - dist[before_d][d] - dist[d][next];
+    }
+};
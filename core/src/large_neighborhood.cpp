@@ -2,12 +2,152 @@
 #include <vector>
 #include <iostream>
 #include <algorithm>
+#include <atomic>
 #include "solvers.hpp"
 #include "structures.hpp"
+#include "thread_pool.hpp"
 
-std::vector<int> create_track_route(Instance const &I, int beam_width, std::vector<int> const &requests);
+namespace
+{
+    struct Candidate
+    {
+        double estimate;
+        int request;
+    };
+
+    // Keeps the `keep` candidates with the smallest estimate at the front of the vector.
+    void keep_best_candidates(std::vector<Candidate> &candidates, int keep)
+    {
+        size_t m = std::min(candidates.size(), (size_t)std::max(1, keep));
+        std::partial_sort(candidates.begin(), candidates.begin() + m, candidates.end(),
+                          [](Candidate const &a, Candidate const &b)
+                          { return a.estimate < b.estimate; });
+        candidates.resize(m);
+    }
+
+    struct ScreeningCounters
+    {
+        std::atomic<size_t> candidates{0};
+        std::atomic<size_t> estimated{0};
+        std::atomic<size_t> exact{0};
+
+        LN::ScreeningCounts load() const
+        {
+            size_t c = candidates.load();
+            size_t e = exact.load();
+            return LN::ScreeningCounts{c, estimated.load(), e, c - e};
+        }
+        void reset()
+        {
+            candidates.store(0);
+            estimated.store(0);
+            exact.store(0);
+        }
+    };
+
+    ScreeningCounters removal_counters;   // find_heaviest_request_in_route
+    ScreeningCounters insertion_counters; // find_best_request_to_add
+
+    gt::Coords route_centroid(Instance const &I, std::vector<int> const &route)
+    {
+        if (route.empty())
+            return I.coords[0];
+        gt::Coords c{0.0, 0.0};
+        for (int node : route)
+        {
+            c.x += I.coords[node].x;
+            c.y += I.coords[node].y;
+        }
+        c.x /= route.size();
+        c.y /= route.size();
+        return c;
+    }
+}
+
+namespace
+{
+    // First minimum in candidate order, so the choice does not depend on scheduling.
+    LN::RequestPair best_request_pair(std::vector<LN::RequestPair> &evaluated, int vehicle)
+    {
+        LN::RequestPair best{-1, vehicle, std::numeric_limits<double>::infinity(), {}};
+        for (auto &pair : evaluated)
+            if (pair.delta < best.delta)
+                best = std::move(pair);
+        return best;
+    }
+
+    std::vector<LN::RequestPair> best_additions_per_vehicle(Instance const &I, Encoding const &encoding, int beam_width, CancellationToken const *cancel, int rescore, int screen_per_rescore)
+    {
+        return parallel_map<LN::RequestPair>(I.nK, [&](size_t vehicle)
+                                             { return LN::find_best_request_to_add(I, encoding, vehicle, beam_width, cancel, rescore, screen_per_rescore); });
+    }
+}
+
+LN::ScreeningStats LN::screening_stats()
+{
+    return ScreeningStats{removal_counters.load(), insertion_counters.load()};
+}
+
+void LN::reset_screening_stats()
+{
+    removal_counters.reset();
+    insertion_counters.reset();
+}
+
+LN::RequestPair LN::find_heaviest_request_in_route(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel, int rescore)
+{
+    if (rescore <= 0)
+        return find_heaviest_request_in_route_exact(I, encoding, vehicle, beam_width, cancel);
+
+    assert(vehicle >= 0 && vehicle < encoding.get_num_vehicles());
+    auto requests = encoding.get_requests_of_route(vehicle);
+
+    if (requests.empty() || requests.size() == 1)
+    {
+        // Same sentinel as in find_heaviest_request_in_route_exact.
+        return RequestPair{-1, vehicle, 0.0, {}};
+    }
 
-LN::RequestPair LN::find_heaviest_request_in_route(Instance const &I, Encoding const &encoding, int vehicle, int beam_width)
+    auto route = cached_track_route(I, beam_width, requests, cancel);
+
+    // Estimate: delete both nodes from the current route. Deliveries come after their pickups.
+    std::vector<Candidate> candidates;
+    candidates.reserve(requests.size());
+    std::vector<int> pickup_idx(I.n, -1);
+    for (int idx = 0; idx < (int)route.route.size(); idx++)
+    {
+        int node = route.route[idx];
+        int req = I.request_of_node[node];
+        if (node <= I.n) // pickup, whatever its demand
+        {
+            pickup_idx[req] = idx;
+            continue;
+        }
+        candidates.push_back(Candidate{insertion::pair_removal_delta(I, route.route, pickup_idx[req], idx), req});
+    }
+    removal_counters.candidates.fetch_add(candidates.size(), std::memory_order_relaxed);
+    removal_counters.estimated.fetch_add(candidates.size(), std::memory_order_relaxed);
+    keep_best_candidates(candidates, rescore);
+    removal_counters.exact.fetch_add(candidates.size(), std::memory_order_relaxed);
+
+    // Beam search only for the most promising ones.
+    auto evaluated = parallel_map<RequestPair>(candidates.size(), [&](size_t c)
+                                               {
+        std::vector<int> rest_requests;
+        rest_requests.reserve(requests.size() - 1);
+        for (int r : requests)
+            if (r != candidates[c].request)
+                rest_requests.push_back(r);
+
+        double delta = cached_track_route(I, beam_width, rest_requests, cancel).distance - route.distance;
+        return RequestPair{candidates[c].request, vehicle, delta, std::move(rest_requests)}; });
+
+    auto best = best_request_pair(evaluated, vehicle);
+    assert(best.request_removed != -1);
+    return best;
+}
+
+LN::RequestPair LN::find_heaviest_request_in_route_exact(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel)
 {
     assert(vehicle >= 0 && vehicle < encoding.get_num_vehicles());
     double best_delta = std::numeric_limits<double>::infinity();
@@ -30,36 +170,39 @@ LN::RequestPair LN::find_heaviest_request_in_route(Instance const &I, Encoding c
         return tortn;
     }
 
-    auto route = create_track_route(I, beam_width, requests);
-    if (route.empty())
+    auto route = cached_track_route(I, beam_width, requests, cancel);
+    if (route.route.empty())
     {
         std::cerr << "ERROR: create_track_route returned empty route for " << requests.size() << " requests" << std::endl;
         std::abort();
     }
 
-    double original_distance = utils::calc_route_distance(I, route);
-    for (auto const &request : requests)
-    {
+    double original_distance = route.distance;
+    auto deltas = parallel_map<double>(requests.size(), [&](size_t i)
+                                       {
         std::vector<int> new_requests;
         new_requests.reserve(requests.size() - 1);
 
         for (auto sec_request : requests)
         {
-            if (sec_request == request)
+            if (sec_request == requests[i])
                 continue;
             new_requests.push_back(sec_request);
         }
 
-        auto new_route = create_track_route(I, beam_width, new_requests);
-        double new_distance = utils::calc_route_distance(I, new_route);
-        double delta = new_distance - original_distance;
-        if (delta < best_delta)
+        return cached_track_route(I, beam_width, new_requests, cancel).distance - original_distance; });
+
+    for (size_t i = 0; i < requests.size(); i++)
+    {
+        if (deltas[i] < best_delta)
         {
-            best_delta = delta;
-            best_request = request;
-            rest_requests = new_requests;
+            best_delta = deltas[i];
+            best_request = requests[i];
         }
     }
+    for (auto sec_request : requests)
+        if (sec_request != best_request)
+            rest_requests.push_back(sec_request);
 
     assert(best_request != -1);
 
@@ -71,62 +214,52 @@ LN::RequestPair LN::find_heaviest_request_in_route(Instance const &I, Encoding c
     return tortn;
 }
 
-Encoding LN::apply_removal(Instance const &I, Encoding const &encoding, std::vector<LN::RequestPair> const &to_be_removed)
+Encoding LN::apply_removal([[maybe_unused]] Instance const &I, Encoding const &encoding, std::vector<LN::RequestPair> const &to_be_removed)
 {
-    auto new_dna = encoding.get_dna_copy();
-    if (to_be_removed.size() == 0)
-    {
-        return {std::move(new_dna)};
-    }
-    auto num_vehicles = encoding.get_num_vehicles();
-    auto num_requests = encoding.get_num_requests();
-    assert(num_vehicles == I.nK);
-    assert(num_requests == I.n);
+    Encoding new_encoding = encoding;
+    assert(new_encoding.get_num_vehicles() == I.nK);
+    assert(new_encoding.get_num_requests() == I.n);
 
     for (auto const &element : to_be_removed)
     {
-        auto vehicle = element.vehicle;
-        auto request = element.request_removed;
-        assert(vehicle < new_dna.size());
-        assert(request < new_dna[0].size());
-
-
-        assert(new_dna[vehicle][request]);
-        new_dna[vehicle][request] = false;
+        assert(element.vehicle < I.nK);
+        assert(element.request_removed < I.n);
+        assert(new_encoding.get_vehicle_of_request(element.request_removed) == element.vehicle);
+        new_encoding.unset_request(element.request_removed);
     }
-    return Encoding{std::move(new_dna)};
+    return new_encoding;
 }
 
-Encoding LN::apply_addition(Instance const &I, Encoding const &encoding, std::vector<LN::RequestPair> const &to_be_removed)
+Encoding LN::apply_addition([[maybe_unused]] Instance const &I, Encoding const &encoding, std::vector<LN::RequestPair> const &to_be_removed)
 {
-    auto new_dna = encoding.get_dna_copy();
+    Encoding new_encoding = encoding;
 
     for (auto const &element : to_be_removed)
     {
-        auto vehicle = element.vehicle;
-        auto request = element.request_removed;
-        assert(!new_dna[vehicle][request]);
-        new_dna[vehicle][request] = true;
+        assert(!new_encoding.is_served(element.request_removed));
+        new_encoding.set_vehicle_for_request(element.vehicle, element.request_removed);
     }
 
-    return {std::move(new_dna)};
+    return new_encoding;
 }
 
-Encoding LN::remove_requests(Instance const &I, Encoding const &encoding, int k, int beam_width)
+Encoding LN::remove_requests(Instance const &I, Encoding const &encoding, int k, int beam_width, CancellationToken const *cancel, int rescore)
 {
-    auto const &dna = encoding.get_dna();
     Encoding new_encoding = encoding;
-    assert(dna.size() == I.nK);
+    assert(new_encoding.get_num_vehicles() == I.nK);
     int removed = 0;
     while (removed < k)
     {
+        // Vehicles are independent given new_encoding; results stay in vehicle order.
+        auto proposals = parallel_map<RequestPair>(I.nK, [&](size_t vehicle)
+                                                   { return find_heaviest_request_in_route(I, new_encoding, vehicle, beam_width, cancel, rescore); });
+
         std::vector<RequestPair> to_be_removed;
-        for (int vehicle = 0; vehicle < I.nK; vehicle++)
+        for (auto &request_pair : proposals)
         {
-            auto request_pair = find_heaviest_request_in_route(I, new_encoding, vehicle, beam_width);
             if (request_pair.request_removed == -1)
                 continue;
-            to_be_removed.push_back(request_pair);
+            to_be_removed.push_back(std::move(request_pair));
         }
 
         assert(new_encoding.get_num_requests() > to_be_removed.size());
@@ -149,36 +282,80 @@ Encoding LN::remove_requests(Instance const &I, Encoding const &encoding, int k,
     return new_encoding;
 }
 
-LN::RequestPair LN::find_best_request_to_add(Instance const &I, Encoding const &encoding, int vehicle, int beam_width)
+LN::RequestPair LN::find_best_request_to_add(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel, int rescore, int screen_per_rescore)
+{
+    if (rescore <= 0)
+        return find_best_request_to_add_exact(I, encoding, vehicle, beam_width, cancel);
+
+    auto non_delivered_requests = encoding.get_non_delivered_requests();
+    auto delivered_requests = encoding.get_requests_of_route(vehicle);
+    auto route = cached_track_route(I, beam_width, delivered_requests, cancel);
+    auto cargo = utils::calc_route_cargo(I, route.route);
+
+    // Stage 1: distance of pickup and delivery to the centroid of the route, O(1) per request.
+    auto centroid = route_centroid(I, route.route);
+    std::vector<Candidate> candidates;
+    candidates.reserve(non_delivered_requests.size());
+    for (auto request : non_delivered_requests)
+    {
+        double d = numerical::calc_distance_between_nodes(centroid, I.coords[1 + request]) +
+                   numerical::calc_distance_between_nodes(centroid, I.coords[1 + I.n + request]);
+        candidates.push_back(Candidate{d, request});
+    }
+    insertion_counters.candidates.fetch_add(candidates.size(), std::memory_order_relaxed);
+    keep_best_candidates(candidates, screen_per_rescore * rescore);
+
+    // Stage 2: cheapest feasible pair insertion into the current route, O(L) per request.
+    auto edges = insertion::route_edges(I, route.route);
+    for (auto &candidate : candidates)
+        candidate.estimate = insertion::cheapest_pair_insertion(I, route.route, cargo, edges, candidate.request).delta;
+    insertion_counters.estimated.fetch_add(candidates.size(), std::memory_order_relaxed);
+    keep_best_candidates(candidates, rescore);
+    insertion_counters.exact.fetch_add(candidates.size(), std::memory_order_relaxed);
+
+    // Beam search only for the most promising ones.
+    auto evaluated = parallel_map<RequestPair>(candidates.size(), [&](size_t c)
+                                               {
+        auto total_requests = delivered_requests;
+        total_requests.push_back(candidates[c].request);
+
+        double delta = cached_track_route(I, beam_width, total_requests, cancel).distance - route.distance;
+        return RequestPair{candidates[c].request, vehicle, delta, std::move(total_requests)}; });
+
+    return best_request_pair(evaluated, vehicle);
+}
+
+LN::RequestPair LN::find_best_request_to_add_exact(Instance const &I, Encoding const &encoding, int vehicle, int beam_width, CancellationToken const *cancel)
 {
 
     double best_delta = std::numeric_limits<double>::infinity();
     int best_request = -1;           // Heaviest
     std::vector<int> total_requests; // Later to store in the solution
 
-    auto const &dna = encoding.get_dna();
     auto non_delivered_requests = encoding.get_non_delivered_requests();
     auto delivered_requests = encoding.get_requests_of_route(vehicle);
-    auto route = create_track_route(I, beam_width, delivered_requests);
-    double original_distance = utils::calc_route_distance(I, route);
+    double original_distance = cached_track_route(I, beam_width, delivered_requests, cancel).distance;
 
-    for (auto request : non_delivered_requests)
-    {
+    auto deltas = parallel_map<double>(non_delivered_requests.size(), [&](size_t i)
+                                       {
         auto new_delivered_requests = delivered_requests;
-        new_delivered_requests.push_back(request);
-        auto new_route = create_track_route(I, beam_width, new_delivered_requests);
-        double new_distance = utils::calc_route_distance(I, new_route);
-
-        double delta = new_distance - original_distance;
-        // assert(delta >= 0);
+        new_delivered_requests.push_back(non_delivered_requests[i]);
+        return cached_track_route(I, beam_width, new_delivered_requests, cancel).distance - original_distance; });
 
-        if (delta < best_delta)
+    for (size_t i = 0; i < non_delivered_requests.size(); i++)
+    {
+        // assert(deltas[i] >= 0);
+        if (deltas[i] < best_delta)
         {
-            best_delta = delta;
-            best_request = request;
-            total_requests = std::move(new_delivered_requests);
+            best_delta = deltas[i];
+            best_request = non_delivered_requests[i];
         }
     }
+    if (best_request != -1)
+    {
+        total_requests = delivered_requests;
+        total_requests.push_back(best_request);
+    }
     RequestPair tortn{ best_request, vehicle, best_delta, std::move(total_requests)};
     // tortn.delta = best_delta;
     // tortn.vehicle = vehicle;
@@ -188,66 +365,68 @@ LN::RequestPair LN::find_best_request_to_add(Instance const &I, Encoding const &
     return tortn;
 }
 
-Encoding LN::append_requests(Instance const &I, Encoding const &encoding, int k, int beam_width)
+Encoding LN::append_requests(Instance const &I, Encoding const &encoding, int k, int beam_width, CancellationToken const *cancel, int rescore, int screen_per_rescore)
 {
-    auto const &dna = encoding.get_dna();
     Encoding new_encoding = encoding;
 
-    assert(dna.size() == I.nK);
-    int addition_iterations = k / I.nK;
-    int additions_in_last_iter = k % I.nK;
-    for (size_t iter = 0; iter < addition_iterations; iter++)
+    assert(new_encoding.get_num_vehicles() == I.nK);
+    // Every round each vehicle proposes its best request. Full rounds take all proposals, the
+    // last one only the k % nK cheapest. A request proposed by several vehicles goes to the
+    // cheapest of them, the others propose again in the next round.
+    int added = 0;
+    while (added < k)
     {
+        auto proposals = best_additions_per_vehicle(I, new_encoding, beam_width, cancel, rescore, screen_per_rescore);
+        std::stable_sort(proposals.begin(), proposals.end(), [](RequestPair const &a, RequestPair const &b)
+                         { return a.delta < b.delta; });
 
         std::vector<RequestPair> to_be_appended;
-        for (int vehicle = 0; vehicle < I.nK; vehicle++)
+        std::vector<bool> taken(I.n, false);
+        for (auto &proposal : proposals)
         {
-            to_be_appended.push_back(find_best_request_to_add(I, new_encoding, vehicle, beam_width));
+            if (added + (int)to_be_appended.size() == k)
+                break;
+            if (proposal.request_removed == -1 || taken[proposal.request_removed])
+                continue;
+            taken[proposal.request_removed] = true;
+            to_be_appended.push_back(std::move(proposal));
         }
+        if (to_be_appended.empty())
+            break; // Nothing left to deliver.
 
         new_encoding = apply_addition(I, new_encoding, to_be_appended);
+        added += to_be_appended.size();
     }
 
-    // Final for modulo requests
-    std::vector<RequestPair> to_be_appended;
-    for (int vehicle = 0; vehicle < I.nK; vehicle++)
-    {
-        to_be_appended.push_back(find_best_request_to_add(I, new_encoding, vehicle, beam_width));
-    }
-    std::partial_sort(to_be_appended.begin(),
-                      to_be_appended.begin() + additions_in_last_iter,
-                      to_be_appended.end(),
-                      [](RequestPair const &a, RequestPair const &b)
-                      { return a.delta < b.delta; });
-
-    // Truncate to only those elements
-    auto to_be_appended_final = std::vector<RequestPair>(to_be_appended.begin(), to_be_appended.begin() + additions_in_last_iter);
-
-    new_encoding = apply_addition(I, new_encoding, to_be_appended_final);
-
     return new_encoding;
 }
 
-Solution LN::large_neighborhood(Instance const &I, Solution const &sol, int k, size_t iters, int bw_remove, int bw_append, std::vector<double>* objectives_over_time)
+Solution LN::large_neighborhood(Instance const &I, Solution const &sol, int k, size_t iters, int bw_remove, int bw_append, std::vector<double>* objectives_over_time, CancellationToken const *cancel, IncumbentObserver *observer, int rescore, int screen_per_rescore)
 {
+    RunClock clock;
     Encoding encoding(I, sol);
     auto new_encoding = encoding;
 
     double best_objective = utils::objective(I, sol);
     Solution best_sol = sol;
+    notify_incumbent(observer, clock, 0, best_objective, best_sol);
 
     for (size_t iter = 0; iter < iters; ++iter)
     {
-        new_encoding = remove_requests(I, new_encoding, k, bw_remove);
-        new_encoding = append_requests(I, new_encoding, k, bw_append);
+        if (cancel && cancel->is_cancelled())
+            break;
+
+        new_encoding = remove_requests(I, new_encoding, k, bw_remove, cancel, rescore);
+        new_encoding = append_requests(I, new_encoding, k, bw_append, cancel, rescore, screen_per_rescore);
 
-        Solution tmp = new_encoding.to_sol(I);
+        Solution tmp = new_encoding.to_sol(I, 5, cancel);
         double tmp_objective = utils::objective(I, tmp);
 
         if (tmp_objective < best_objective)
         {
             best_objective = tmp_objective;
             best_sol = tmp;
+            notify_incumbent(observer, clock, iter + 1, best_objective, best_sol);
         }
 
         if(objectives_over_time){
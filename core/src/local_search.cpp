@@ -10,8 +10,11 @@ Solution LS::local_search(
     const Neighborhood::NeighborhoodFactory &neigh_factory,
     StepFunction::Func step_function,
     StoppingCriterion &criterion,
-    int* iteration_ptr)
+    int* iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
 {
+    RunClock clock;
 
     Solution sol = initial_sol; // copy
     if(sol.fairness != I.fairness){
@@ -21,8 +24,10 @@ Solution LS::local_search(
     
 
     double f = utils::objective(I, sol);
+    double best_f = f;
     size_t iteration = 0;
-    static std::mt19937 rng(std::random_device{}());
+    notify_incumbent(observer, clock, iteration, f, sol);
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
 
     criterion.reset();
 
@@ -41,6 +46,12 @@ Solution LS::local_search(
         sol = neigh->apply(*mov);
         f = utils::objective(I, sol);
         ++iteration;
+
+        if (f < best_f)
+        {
+            best_f = f;
+            notify_incumbent(observer, clock, iteration, f, sol);
+        }
     }
     if (iteration_ptr != nullptr){
         *iteration_ptr = iteration;
@@ -65,7 +65,7 @@ std::vector<GenericMove> IntraRouteNeighborhood::generate() const
 }
 
 std::optional<GenericMove>
-IntraRouteNeighborhood::generate_random(std::mt19937 &rng) const
+IntraRouteNeighborhood::generate_random(rng::Engine &rng) const
 {
     if (sol.routes.empty())
         return std::nullopt;
@@ -376,7 +376,7 @@ Solution IntraRouteNeighborhood::apply(const GenericMove &mov) const
 // }
 
 // std::optional<GenericMove>
-// PairRelocateNeighborhood::generate_random(std::mt19937 &rng) const
+// PairRelocateNeighborhood::generate_random(rng::Engine &rng) const
 // {
 //     int R = (int)sol.routes.size();
 //     if (R < 2)
@@ -608,7 +608,7 @@ std::vector<GenericMove> RequestMove::generate() const
     return to_rtn;
 }
 
-std::optional<GenericMove> RequestMove::generate_random(std::mt19937 &rng) const
+std::optional<GenericMove> RequestMove::generate_random(rng::Engine &rng) const
 {
     assert(sol.routes.size() == I.nK);
     std::uniform_int_distribution<int> routes_dist(0, I.nK - 1);
@@ -883,7 +883,7 @@ std::vector<GenericMove> TwoOptNeighborhood::generate() const
 }
 
 std::optional<GenericMove>
-TwoOptNeighborhood::generate_random(std::mt19937 &rng) const
+TwoOptNeighborhood::generate_random(rng::Engine &rng) const
 {
     if (sol.routes.empty())
         return std::nullopt;
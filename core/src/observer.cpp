@@ -0,0 +1,94 @@
+#include <stdexcept>
+#include "observer.hpp"
+
+IncumbentStream::IncumbentStream(std::string const &path, size_t capacity, int flush_ms)
+    : out(path), flush_ms(flush_ms)
+{
+    if (!out)
+        throw std::runtime_error("Could not open file for writing: " + path);
+
+    // Round up to a power of two so that positions wrap with a mask.
+    size_t size = 2;
+    while (size < capacity)
+        size *= 2;
+    ring = std::vector<Slot>(size);
+    mask = size - 1;
+    for (size_t i = 0; i < size; i++)
+        ring[i].seq.store(i, std::memory_order_relaxed);
+
+    out << "elapsed_ms,iteration,objective\n";
+    writer = std::thread(&IncumbentStream::run, this);
+}
+
+IncumbentStream::~IncumbentStream()
+{
+    {
+        std::lock_guard<std::mutex> lock(wake_mutex);
+        running = false;
+    }
+    wake.notify_one();
+    writer.join();
+    drain();
+    out.flush();
+}
+
+// Bounded MPMC queue after D. Vyukov. Every slot carries a sequence number telling
+// whether it is free for position pos (seq == pos) or holds the record of pos (seq == pos + 1).
+void IncumbentStream::on_incumbent(Incumbent const &incumbent, Solution const &)
+{
+    size_t pos = head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        Slot &slot = ring[pos & mask];
+        size_t seq = slot.seq.load(std::memory_order_acquire);
+        auto diff = (std::ptrdiff_t)seq - (std::ptrdiff_t)pos;
+        if (diff == 0)
+        {
+            if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                slot.incumbent = incumbent;
+                slot.seq.store(pos + 1, std::memory_order_release);
+                return;
+            }
+        }
+        else if (diff < 0)
+        {
+            dropped.fetch_add(1, std::memory_order_relaxed); // full
+            return;
+        }
+        else
+        {
+            pos = head.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+void IncumbentStream::drain()
+{
+    for (;;)
+    {
+        Slot &slot = ring[tail & mask];
+        if (slot.seq.load(std::memory_order_acquire) != tail + 1)
+            break;
+        Incumbent const inc = slot.incumbent;
+        slot.seq.store(tail + mask + 1, std::memory_order_release);
+        tail++;
+        out << inc.elapsed_ms << "," << inc.iteration << "," << inc.objective << "\n";
+    }
+}
+
+void IncumbentStream::run()
+{
+    std::unique_lock<std::mutex> lock(wake_mutex);
+    while (running)
+    {
+        wake.wait_for(lock, std::chrono::milliseconds(flush_ms));
+        drain();
+        out.flush();
+    }
+}
+
+size_t IncumbentStream::num_dropped() const
+{
+    return dropped.load(std::memory_order_relaxed);
+}
@@ -49,10 +49,9 @@ std::vector<Candidate> collect_candidates(
 int choose_candidate_index(
     const std::vector<Candidate> &C,
     bool greedy,
-    double lambda_exp)
+    double lambda_exp,
+    rng::Engine &rng)
 {
-
-    static thread_local std::mt19937 rng(std::random_device{}());
     std::vector<int> idx(C.size());
     std::iota(idx.begin(), idx.end(), 0);
 
@@ -109,7 +108,8 @@ std::vector<int> build_route(
     const Instance &I,
     const std::vector<int> &reqs,
     bool greedy,
-    double lambda_exp)
+    double lambda_exp,
+    rng::Engine &rng)
 {
     std::vector<int> unpicked = reqs;
     std::vector<int> active;
@@ -130,7 +130,7 @@ std::vector<int> build_route(
         }
         else
         {
-            int ci = choose_candidate_index(C, greedy, lambda_exp);
+            int ci = choose_candidate_index(C, greedy, lambda_exp, rng);
             choice = C[ci];
         }
 
@@ -181,11 +181,13 @@ auto select_gamma_requests_random(Instance const &I)
 
 Solution RC::construction(
     const Instance &I,
-    double lamda)
+    double lamda,
+    rng::Engine *engine)
 {
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
     auto indices_of_requests_to_serve = select_gamma_requests_random(I);
 
-    std::vector<int> assign = clusters::balanced_kmeans(I, indices_of_requests_to_serve, 20, 20);
+    std::vector<int> assign = clusters::balanced_kmeans(I, indices_of_requests_to_serve, 20, 20, &rng);
     gt::Matrix<int> per_track(I.nK); // per track requests-responibilities
     // for (int r = 0; r < I.n; r++)
     //     per_track[assign[r]].push_back(r);
@@ -201,7 +203,7 @@ Solution RC::construction(
     routes.reserve(I.nK);
     for (int k = 0; k < I.nK; k++)
     {
-        auto route = build_route(I, per_track[k], false, lamda);
+        auto route = build_route(I, per_track[k], false, lamda, rng);
         routes.push_back(std::move(route));
     }
 
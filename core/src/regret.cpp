@@ -0,0 +1,211 @@
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <iostream>
+#include <queue>
+#include "solvers.hpp"
+#include "structures.hpp"
+
+namespace
+{
+    constexpr double INF = std::numeric_limits<double>::infinity();
+    // Stands in for the cost of a vehicle the request does not fit into, so that requests with
+    // few options left are inserted first.
+    constexpr double MISSING_OPTION = 1e9;
+
+    struct Entry
+    {
+        double regret;
+        double cost;
+        int request;
+        unsigned version;
+    };
+
+    struct EntryOrder
+    {
+        bool operator()(Entry const &a, Entry const &b) const
+        {
+            if (a.regret != b.regret)
+                return a.regret < b.regret;
+            if (a.cost != b.cost)
+                return a.cost > b.cost;
+            return a.request > b.request;
+        }
+    };
+
+    class RegretQueue
+    {
+        Instance const &I;
+        std::vector<std::vector<int>> &routes;
+        int nK;
+        int k;
+
+        // cost[v][r]: cheapest insertion of unserved request r into vehicle v.
+        std::vector<std::vector<insertion::PairInsertion>> cost;
+        std::vector<int> unserved;
+        std::vector<int> position; // of r in unserved, -1 once inserted or dropped
+        std::vector<unsigned> version;
+        std::vector<double> regret;
+        std::vector<double> best_cost;
+        std::vector<int> best_vehicle;
+        std::priority_queue<Entry, std::vector<Entry>, EntryOrder> queue;
+        std::vector<double> column;
+
+        void compute_row(int v)
+        {
+            auto cargo = utils::calc_route_cargo(I, routes[v]);
+            auto edges = insertion::route_edges(I, routes[v]);
+            // In request order, neighbouring requests share the cache lines of dist.
+            for (int r = 0; r < I.n; r++)
+                if (position[r] != -1)
+                    cost[v][r] = insertion::cheapest_pair_insertion(I, routes[v], cargo, edges, r);
+        }
+
+        // Regret of r from its column. Returns false if r fits nowhere.
+        bool evaluate(int r)
+        {
+            for (int v = 0; v < nK; v++)
+                column[v] = cost[v][r].delta;
+            int v_min = (int)(std::min_element(column.begin(), column.end()) - column.begin());
+            double c1 = column[v_min];
+            if (c1 == INF)
+                return false;
+
+            double reg = 0.0;
+            int m = std::min(k, nK);
+            if (m > 1)
+            {
+                std::partial_sort(column.begin(), column.begin() + m, column.end());
+                for (int j = 1; j < m; j++)
+                    reg += column[j] == INF ? MISSING_OPTION : column[j] - c1;
+            }
+            regret[r] = reg;
+            best_cost[r] = c1;
+            best_vehicle[r] = v_min;
+            return true;
+        }
+
+        void remove_unserved(int r)
+        {
+            int pos = position[r];
+            unserved[pos] = unserved.back();
+            position[unserved[pos]] = pos;
+            unserved.pop_back();
+            position[r] = -1;
+        }
+
+        void push(int r)
+        {
+            version[r]++;
+            if (evaluate(r))
+                queue.push(Entry{regret[r], best_cost[r], r, version[r]});
+            else
+                remove_unserved(r); // Loads only grow, it will not fit later either.
+        }
+
+    public:
+        RegretQueue(Instance const &I, std::vector<std::vector<int>> &routes, int k)
+            : I(I), routes(routes), nK((int)routes.size()), k(std::max(1, k)),
+              cost(nK, std::vector<insertion::PairInsertion>(I.n)), position(I.n, -1),
+              version(I.n, 0), regret(I.n, 0.0), best_cost(I.n, INF), best_vehicle(I.n, -1), column(nK)
+        {
+            std::vector<bool> served(I.n, false);
+            for (auto const &route : routes)
+                for (int node : route)
+                    served[I.request_of_node[node]] = true;
+            for (int r = 0; r < I.n; r++)
+            {
+                if (served[r])
+                    continue;
+                position[r] = (int)unserved.size();
+                unserved.push_back(r);
+            }
+
+            for (int v = 0; v < nK; v++)
+                compute_row(v);
+            auto initial = unserved;
+            for (int r : initial)
+                push(r);
+        }
+
+        bool empty()
+        {
+            while (!queue.empty() && queue.top().version != version[queue.top().request])
+                queue.pop();
+            return queue.empty();
+        }
+
+        // Inserts the request with the largest regret and refreshes the row of its vehicle.
+        LN::RequestPair insert_next()
+        {
+            assert(!empty());
+            int r = queue.top().request;
+            queue.pop();
+            int v = best_vehicle[r];
+            double delta = best_cost[r];
+
+            insertion::apply_pair_insertion(I, routes[v], r, cost[v][r]);
+            remove_unserved(r);
+            version[r]++;
+
+            // Only the row of v changed. A request is re-queued only if v is among its k
+            // cheapest vehicles now or was before, otherwise its regret is unchanged.
+            auto old_row = cost[v];
+            compute_row(v);
+            auto remaining = unserved;
+            for (int u : remaining)
+            {
+                double kth = kth_cost(u, v, old_row[u].delta);
+                if (old_row[u].delta <= kth || cost[v][u].delta <= kth)
+                    push(u);
+            }
+            return LN::RequestPair{r, v, delta, {}};
+        }
+
+    private:
+        // k-th smallest cost of u over all vehicles, using old_v_cost for vehicle v.
+        double kth_cost(int u, int v, double old_v_cost)
+        {
+            for (int w = 0; w < nK; w++)
+                column[w] = w == v ? old_v_cost : cost[w][u].delta;
+            int m = std::min(k, nK);
+            std::nth_element(column.begin(), column.begin() + (m - 1), column.end());
+            return column[m - 1];
+        }
+    };
+}
+
+std::vector<LN::RequestPair> REGRET::insert(Instance const &I, std::vector<std::vector<int>> &routes, int to_add, int k)
+{
+    std::vector<LN::RequestPair> added;
+    if (to_add <= 0)
+        return added;
+    RegretQueue queue(I, routes, k);
+    while ((int)added.size() < to_add && !queue.empty())
+        added.push_back(queue.insert_next());
+    return added;
+}
+
+Encoding REGRET::repair(Instance const &I, Encoding const &encoding, int k, int beam_width, CancellationToken const *cancel)
+{
+    auto routes = encoding.to_sol(I, beam_width, cancel).routes;
+    int to_add = I.gamma - encoding.total_num_of_requests();
+    auto added = insert(I, routes, to_add, k);
+    if ((int)added.size() < to_add)
+        std::cerr << "WARNING: regret repair inserted " << added.size() << " of " << to_add << " requests" << std::endl;
+    return LN::apply_addition(I, encoding, added);
+}
+
+Solution REGRET::construction(Instance const &I, int k)
+{
+    Solution sol;
+    sol.routes.resize(I.nK);
+    auto added = insert(I, sol.routes, I.gamma, k);
+    if ((int)added.size() < I.gamma)
+    {
+        std::cerr << "ERROR: regret construction served " << added.size() << " of " << I.gamma << " requests" << std::endl;
+        std::abort();
+    }
+    sol.compute_cached_values_from_routes(I);
+    return sol;
+}
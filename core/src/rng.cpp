@@ -0,0 +1,60 @@
+#include <atomic>
+#include <mutex>
+#include <random>
+#include "rng.hpp"
+
+namespace
+{
+    std::mutex seed_mutex;
+    bool seeded = false;
+    uint64_t base_seed = 0;
+    // Bumped by set_seed so that thread engines notice.
+    std::atomic<uint64_t> seed_epoch{0};
+    std::atomic<uint64_t> next_thread_stream{0};
+
+    // Thread streams live apart from the ids a caller would pass to rng::stream.
+    constexpr uint64_t THREAD_STREAMS = uint64_t{1} << 62;
+}
+
+uint64_t rng::seed()
+{
+    std::lock_guard<std::mutex> lock(seed_mutex);
+    if (!seeded)
+    {
+        std::random_device rd;
+        base_seed = ((uint64_t)rd() << 32) ^ rd();
+        seeded = true;
+    }
+    return base_seed;
+}
+
+void rng::set_seed(uint64_t seed)
+{
+    {
+        std::lock_guard<std::mutex> lock(seed_mutex);
+        base_seed = seed;
+        seeded = true;
+    }
+    next_thread_stream.store(0);
+    seed_epoch.fetch_add(1);
+}
+
+rng::Engine rng::stream(uint64_t id)
+{
+    return Engine(seed(), id);
+}
+
+rng::Engine &rng::thread_engine()
+{
+    struct ThreadEngine
+    {
+        uint64_t epoch;
+        Engine engine;
+    };
+    static thread_local ThreadEngine local{~uint64_t{0}, Engine(0)};
+
+    uint64_t epoch = seed_epoch.load();
+    if (local.epoch != epoch)
+        local = ThreadEngine{epoch, Engine(seed(), THREAD_STREAMS + next_thread_stream.fetch_add(1))};
+    return local.engine;
+}
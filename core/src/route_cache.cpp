@@ -0,0 +1,132 @@
+#include <functional>
+#include "route_cache.hpp"
+#include "solvers.hpp"
+
+namespace
+{
+    inline uint64_t mix64(uint64_t x)
+    {
+        // splitmix64 finalizer
+        x += 0x9e3779b97f4a7c15ULL;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+        return x ^ (x >> 31);
+    }
+}
+
+RouteCache &RouteCache::global()
+{
+    static RouteCache cache;
+    return cache;
+}
+
+RouteCache::RouteCache(size_t capacity)
+    : capacity_per_shard(std::max<size_t>(1, capacity / NUM_SHARDS)) {}
+
+// Both halves are sums over the requests, so the key does not depend on their order.
+RouteCache::Key RouteCache::make_key(Instance const &I, int beam_width, std::vector<int> const &requests)
+{
+    uint64_t lo = 0;
+    uint64_t hi = 0;
+    for (int r : requests)
+    {
+        lo += mix64((uint64_t)r);
+        hi += mix64((uint64_t)r ^ 0x5bd1e9955bd1e995ULL);
+    }
+    uint64_t context = mix64(std::hash<std::string>{}(I.name) ^ ((uint64_t)I.n << 32) ^ (uint64_t)I.C);
+    lo ^= mix64(context ^ (uint64_t)beam_width);
+    hi ^= mix64(context + ((uint64_t)requests.size() << 20) + (uint64_t)beam_width);
+    return Key{lo, hi};
+}
+
+bool RouteCache::lookup(Key const &key, Entry &out)
+{
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it == shard.index.end())
+    {
+        misses.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+    out = it->second->second;
+    hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+void RouteCache::insert(Key const &key, Entry entry)
+{
+    Shard &shard = shard_of(key);
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(key);
+    if (it != shard.index.end())
+    {
+        // Another thread built the same route meanwhile.
+        shard.lru.splice(shard.lru.begin(), shard.lru, it->second);
+        return;
+    }
+
+    shard.lru.emplace_front(key, std::move(entry));
+    shard.index.emplace(key, shard.lru.begin());
+
+    size_t capacity = capacity_per_shard.load(std::memory_order_relaxed);
+    while (shard.lru.size() > capacity)
+    {
+        shard.index.erase(shard.lru.back().first);
+        shard.lru.pop_back();
+        evictions.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void RouteCache::clear()
+{
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        shard.index.clear();
+        shard.lru.clear();
+    }
+}
+
+void RouteCache::set_capacity(size_t capacity)
+{
+    capacity_per_shard.store(std::max<size_t>(1, capacity / NUM_SHARDS), std::memory_order_relaxed);
+}
+
+RouteCache::Stats RouteCache::stats() const
+{
+    size_t size = 0;
+    for (auto &shard : shards)
+    {
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        size += shard.lru.size();
+    }
+    return Stats{hits.load(), misses.load(), evictions.load(), size};
+}
+
+void RouteCache::reset_stats()
+{
+    hits.store(0);
+    misses.store(0);
+    evictions.store(0);
+}
+
+RouteCache::Entry cached_track_route(Instance const &I, int beam_width, std::vector<int> const &requests, CancellationToken const *cancel)
+{
+    if (requests.empty())
+        return RouteCache::Entry{{}, 0.0};
+
+    auto &cache = RouteCache::global();
+    auto key = RouteCache::make_key(I, beam_width, requests);
+
+    RouteCache::Entry entry;
+    if (cache.lookup(key, entry))
+        return entry;
+
+    entry.route = create_track_route(I, beam_width, requests, cancel);
+    entry.distance = utils::calc_route_distance(I, entry.route);
+    if (!(cancel && cancel->is_cancelled()))
+        cache.insert(key, entry);
+    return entry;
+}
@@ -1,30 +1,17 @@
+#include <atomic>
 #include <chrono>
 #include <iostream>
+#include <limits>
 #include <optional>
+#include "annealing.hpp"
 #include "neighborhoods.hpp"
 #include "solvers.hpp"
 #include "structures.hpp"
+#include "thread_pool.hpp"
 
 #include "stopping_criteria.hpp"
 #include "step_function.hpp"
 
-bool do_i_accept(double delta, double T, std::mt19937 &rng)
-{
-    static std::uniform_real_distribution<double> uni(0.0, 1.0);
-
-    if (delta < 0.0)
-    {
-        return true;
-    }
-    else
-    {
-        double p = std::exp(-delta / T);
-        if (uni(rng) < p)
-            return true;
-    }
-    return false;
-}
-
 Solution SA::simulated_annealing(
     const Instance &I,
     const Solution &initial_sol,
@@ -34,16 +21,20 @@ Solution SA::simulated_annealing(
     double cooling,
     StepFunction::Func step_function, // Random move preferebaly
     StoppingCriterion &stopping_criterion,
-    int *iteration_ptr )
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
 {
+    RunClock clock;
 
-    static std::mt19937 rng(std::random_device{}());
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
     Solution sol = initial_sol;
     Solution best_sol = sol;
     double f = utils::objective(I, sol);
     double best_f = f;
     double T = T_start;
     size_t i = 0;
+    notify_incumbent(observer, clock, i, best_f, best_sol);
 
     while (!stopping_criterion(i, best_f))
     {
@@ -59,7 +50,7 @@ Solution SA::simulated_annealing(
         }
         auto actual_move = mov.value();
         double delta = neigh->calc_delta(actual_move);
-        bool accept = do_i_accept(delta, T, rng);
+        bool accept = delta < AnnealingState::acceptance_threshold(T, rng);
 
         if (accept)
         {
@@ -70,6 +61,7 @@ Solution SA::simulated_annealing(
             {
                 best_f = f;
                 best_sol = sol;
+                notify_incumbent(observer, clock, i, best_f, best_sol);
             }
         }
 
@@ -83,6 +75,321 @@ Solution SA::simulated_annealing(
     return best_sol;
 }
 
+namespace
+{
+    // Acceptance rate, measured over ACCEPTANCE_WINDOW steps, below which SA turns speculative.
+    constexpr size_t ACCEPTANCE_WINDOW = 4096;
+    constexpr double SPECULATIVE_BELOW = 0.01;
+    // Proposals evaluated per synchronisation, and per claim of a thread. Batches of 256 lost
+    // up to 30% of the throughput to pool overhead, 4096 gained nothing over 1024.
+    constexpr size_t SPECULATIVE_BATCH = 1024;
+    constexpr size_t SPECULATIVE_CHUNK = 64;
+
+    struct Speculation
+    {
+        size_t index; // into the batch
+        AnnealingState::Move move;
+    };
+
+    // Proposal j of a batch draws from rng::Engine(seed, first_step + j) in both versions below,
+    // so they return the same move and which one runs only changes the speed.
+    std::optional<Speculation> first_accepted_serial(AnnealingState const &state, uint64_t seed, size_t first_step,
+                                                     std::vector<double> const &temperatures)
+    {
+        for (size_t j = 0; j < temperatures.size(); j++)
+        {
+            rng::Engine rng(seed, first_step + j);
+            auto mov = state.propose(rng, AnnealingState::acceptance_threshold(temperatures[j], rng));
+            if (mov.has_value())
+                return Speculation{j, *mov};
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * Evaluates one proposal per temperature against the same state, in parallel, and returns
+     * the first one accepted, whatever the number of threads or their timing. Chunks stop at
+     * the first acceptance known to be earlier than what they would evaluate next.
+     */
+    std::optional<Speculation> first_accepted(AnnealingState const &state, uint64_t seed, size_t first_step,
+                                              std::vector<double> const &temperatures)
+    {
+        size_t count = temperatures.size();
+        size_t num_chunks = (count + SPECULATIVE_CHUNK - 1) / SPECULATIVE_CHUNK;
+        std::atomic<size_t> first{count};
+        std::vector<std::optional<AnnealingState::Move>> found(num_chunks);
+
+        ThreadPool::global().parallel_for(num_chunks, [&](size_t c)
+                                          {
+            size_t end = std::min(count, (c + 1) * SPECULATIVE_CHUNK);
+            for (size_t j = c * SPECULATIVE_CHUNK; j < end && j < first.load(std::memory_order_relaxed); j++)
+            {
+                rng::Engine rng(seed, first_step + j);
+                found[c] = state.propose(rng, AnnealingState::acceptance_threshold(temperatures[j], rng));
+                if (!found[c].has_value())
+                    continue;
+
+                size_t seen = first.load(std::memory_order_relaxed);
+                while (j < seen && !first.compare_exchange_weak(seen, j, std::memory_order_relaxed))
+                    ;
+                return;
+            } });
+
+        size_t j = first.load();
+        if (j == count)
+            return std::nullopt;
+        return Speculation{j, *found[j / SPECULATIVE_CHUNK]};
+    }
+
+    /**
+     * Picks, per batch, between first_accepted and first_accepted_serial by the time each took
+     * per step the chain advanced. The slower one is retried every PROBE_EVERY batches, so a
+     * change in load is noticed. Without workers batches always run serially.
+     */
+    class BatchScheduler
+    {
+        static constexpr size_t PROBE_EVERY = 64;
+        bool has_workers = ThreadPool::global().num_workers() > 0;
+        double ns_per_step[2] = {0.0, 0.0}; // serial, parallel; 0 = not measured yet
+        size_t batches = 0;
+
+    public:
+        std::optional<Speculation> run(AnnealingState const &state, uint64_t seed, size_t first_step,
+                                       std::vector<double> const &temperatures)
+        {
+            bool parallel = has_workers;
+            if (has_workers && ns_per_step[0] > 0.0 && ns_per_step[1] > 0.0)
+            {
+                parallel = ns_per_step[1] < ns_per_step[0];
+                if (++batches % PROBE_EVERY == 0)
+                    parallel = !parallel;
+            }
+            else if (has_workers && ns_per_step[1] > 0.0)
+                parallel = false;
+
+            auto start = std::chrono::steady_clock::now();
+            auto hit = parallel ? first_accepted(state, seed, first_step, temperatures)
+                                : first_accepted_serial(state, seed, first_step, temperatures);
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            size_t steps = hit.has_value() ? hit->index + 1 : temperatures.size();
+            double &estimate = ns_per_step[parallel];
+            estimate = estimate > 0.0 ? 0.8 * estimate + 0.2 * ns / steps : ns / steps;
+            return hit;
+        }
+    };
+}
+
+Solution SA::simulated_annealing(
+    const Instance &I,
+    const Solution &initial_sol,
+    double T_start,
+    double T_end,
+    double cooling,
+    StoppingCriterion &stopping_criterion,
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
+{
+    RunClock clock;
+
+    rng::Engine &rng = engine ? *engine : rng::thread_engine();
+    AnnealingChain chain(I, initial_sol);
+
+    double T = T_start;
+    size_t i = 0;
+    Solution incumbent; // observer copy, refreshed in place
+    auto notify = [&]
+    {
+        if (!observer)
+            return;
+        chain.state().write_solution(incumbent);
+        notify_incumbent(observer, clock, i, chain.best_objective(), incumbent);
+    };
+    notify();
+
+    // Hot phase: one step at a time. Once nearly every proposal is rejected, the next
+    // SPECULATIVE_BATCH steps are proposed at once against the current state. The first
+    // accepted one is committed and the batch restarts after it, so the chain is the one a
+    // serial run with the same streams would walk. The stopping criterion is then checked
+    // once per batch, and a batch never runs past the iterations it has left.
+    bool speculative = false;
+    uint64_t speculative_seed = 0;
+    size_t window_accepted = 0;
+    std::vector<double> temperatures;
+    temperatures.reserve(SPECULATIVE_BATCH);
+    BatchScheduler scheduler;
+    while (!stopping_criterion(i, chain.best_objective()))
+    {
+        if (!speculative)
+        {
+            T = std::max(T, T_end);
+            auto step = chain.step(rng, T);
+            if (step != AnnealingChain::REJECTED)
+                window_accepted++;
+            if (step == AnnealingChain::IMPROVED)
+                notify();
+
+            T *= cooling;
+            i++;
+            if (i % ACCEPTANCE_WINDOW == 0)
+            {
+                speculative = window_accepted < SPECULATIVE_BELOW * ACCEPTANCE_WINDOW;
+                speculative_seed = rng();
+                window_accepted = 0;
+            }
+            continue;
+        }
+
+        size_t batch = std::min<size_t>(SPECULATIVE_BATCH, std::max(1, stopping_criterion.iterations_left(i)));
+        temperatures.clear();
+        for (size_t j = 0; j < batch; j++)
+        {
+            T = std::max(T, T_end);
+            temperatures.push_back(T);
+            T *= cooling;
+        }
+
+        auto hit = scheduler.run(chain.state(), speculative_seed, i, temperatures);
+        if (!hit.has_value())
+        {
+            i += batch;
+            continue;
+        }
+        i += hit->index + 1;
+        T = temperatures[hit->index] * cooling;
+        if (chain.apply(hit->move))
+            notify();
+    }
+    if (iteration_ptr != nullptr)
+        *iteration_ptr = i;
+
+    return chain.best_solution();
+}
+
+namespace
+{
+    // T_max / T_min of calibrated ladders.
+    constexpr double LADDER_RATIO = 1000.0;
+    constexpr int CALIBRATION_SAMPLES = 1000;
+
+    // Average objective increase of feasible random moves of sol, 0 if none goes uphill.
+    double average_uphill_delta(Instance const &I, Solution const &sol, rng::Engine &rng)
+    {
+        AnnealingState state(I, sol);
+        double total = 0.0;
+        int uphill = 0;
+        for (int k = 0; k < CALIBRATION_SAMPLES; k++)
+        {
+            auto mov = state.propose(rng, std::numeric_limits<double>::infinity());
+            if (mov.has_value() && mov->delta > 0.0)
+            {
+                total += mov->delta;
+                uphill++;
+            }
+        }
+        return uphill > 0 ? total / uphill : 0.0;
+    }
+}
+
+Solution SA::parallel_tempering(
+    const Instance &I,
+    const Solution &initial_sol,
+    TemperingParams const &params,
+    StoppingCriterion &stopping_criterion,
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    std::vector<ReplicaReport> *reports,
+    rng::Engine *engine)
+{
+    RunClock clock;
+
+    rng::Engine &parent = engine ? *engine : rng::thread_engine();
+    int num_replicas = std::max(2, params.replicas > 0 ? params.replicas : (int)ThreadPool::global().num_workers() + 1);
+    int interval = std::max(1, params.swap_interval);
+
+    double T_min = params.T_min;
+    double T_max = params.T_max;
+    if (T_max <= 0.0)
+        T_max = std::max(average_uphill_delta(I, initial_sol, parent), 1e-9) / std::log(2.0);
+    if (T_min <= 0.0)
+        T_min = T_max / LADDER_RATIO;
+
+    struct Replica
+    {
+        AnnealingChain chain;
+        rng::Engine rng;
+    };
+    std::vector<Replica> replicas;
+    replicas.reserve(num_replicas);
+    std::vector<int> at(num_replicas); // replica at each temperature, coldest first
+    std::vector<ReplicaReport> slots(num_replicas);
+    for (int k = 0; k < num_replicas; k++)
+    {
+        replicas.push_back(Replica{AnnealingChain(I, initial_sol), parent.split(k)});
+        at[k] = k;
+        slots[k].temperature = T_min * std::pow(T_max / T_min, (double)k / (num_replicas - 1));
+        slots[k].best_objective = replicas[k].chain.best_objective();
+    }
+
+    double best_f = replicas[0].chain.best_objective();
+    int best_replica = 0;
+    size_t i = 0;
+    if (observer)
+        notify_incumbent(observer, clock, i, best_f, initial_sol);
+
+    for (size_t round = 0; !stopping_criterion(i, best_f); round++)
+    {
+        ThreadPool::global().parallel_for(num_replicas, [&](size_t k)
+                                          {
+            Replica &replica = replicas[at[k]];
+            ReplicaReport &slot = slots[k];
+            for (int step = 0; step < interval; step++)
+            {
+                auto result = replica.chain.step(replica.rng, slot.temperature);
+                if (result == AnnealingChain::REJECTED)
+                    continue;
+                slot.accepted++;
+                if (result == AnnealingChain::IMPROVED)
+                    slot.best_objective = std::min(slot.best_objective, replica.chain.best_objective());
+            }
+            slot.iterations += interval; });
+        i += interval;
+
+        bool improved = false;
+        for (int r = 0; r < num_replicas; r++)
+        {
+            if (replicas[r].chain.best_objective() < best_f)
+            {
+                best_f = replicas[r].chain.best_objective();
+                best_replica = r;
+                improved = true;
+            }
+        }
+        if (improved && observer)
+            notify_incumbent(observer, clock, i, best_f, replicas[best_replica].chain.best_solution());
+
+        // Exchange k and k + 1 with probability min(1, exp((1/T_k - 1/T_k+1)(E_k - E_k+1))).
+        for (int k = round % 2; k + 1 < num_replicas; k += 2)
+        {
+            double cold = replicas[at[k]].chain.state().objective();
+            double hot = replicas[at[k + 1]].chain.state().objective();
+            double log_ratio = (1.0 / slots[k].temperature - 1.0 / slots[k + 1].temperature) * (cold - hot);
+            slots[k].swaps_attempted++;
+            if (-log_ratio < AnnealingState::acceptance_threshold(1.0, parent))
+            {
+                std::swap(at[k], at[k + 1]);
+                slots[k].swaps_accepted++;
+            }
+        }
+    }
+    if (iteration_ptr != nullptr)
+        *iteration_ptr = i;
+    if (reports)
+        *reports = std::move(slots);
+
+    return replicas[best_replica].chain.best_solution();
+}
+
 // Solution SA::simulated_annealing(
 //     const Instance &I,
 //     const Solution &initial_sol,
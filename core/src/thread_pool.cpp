@@ -0,0 +1,90 @@
+#include <algorithm>
+#include "thread_pool.hpp"
+
+ThreadPool &ThreadPool::global()
+{
+    static ThreadPool pool;
+    return pool;
+}
+
+size_t ThreadPool::default_num_workers()
+{
+    unsigned int cores = std::thread::hardware_concurrency();
+    return cores > 1 ? cores - 1 : 0;
+}
+
+ThreadPool::ThreadPool(size_t num_workers)
+{
+    workers.reserve(num_workers);
+    for (size_t i = 0; i < num_workers; i++)
+        workers.emplace_back(&ThreadPool::work, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::work()
+{
+    for (;;)
+    {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]
+                      { return stopping || !tasks.empty(); });
+            if (tasks.empty())
+                return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+void ThreadPool::run_loop(Loop &loop)
+{
+    for (;;)
+    {
+        size_t i = loop.next.fetch_add(1, std::memory_order_relaxed);
+        if (i >= loop.n)
+            return;
+
+        if (!loop.failed.load(std::memory_order_relaxed))
+        {
+            try
+            {
+                loop.body(i);
+            }
+            catch (...)
+            {
+                std::lock_guard<std::mutex> lock(loop.mutex);
+                if (!loop.error)
+                    loop.error = std::current_exception();
+                loop.failed.store(true, std::memory_order_relaxed);
+            }
+        }
+
+        if (loop.finished.fetch_add(1, std::memory_order_acq_rel) + 1 == loop.n)
+        {
+            std::lock_guard<std::mutex> lock(loop.mutex);
+            loop.done.notify_all();
+        }
+    }
+}
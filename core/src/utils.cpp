@@ -241,9 +241,9 @@ namespace numerical
     }
 
     template <typename T>
-    T select_uniformly(const std::vector<T> &org, std::mt19937 &rng)
+    T select_uniformly(const std::vector<T> &org, rng::Engine &rng)
     {
-        std::uniform_int_distribution<int> idx(0, org.size());
+        std::uniform_int_distribution<int> idx(0, (int)org.size() - 1);
         size_t i = idx(rng);
         return org[i];
     }
@@ -258,5 +258,5 @@ namespace numerical
 };
 template std::vector<int> numerical::argsort<double>(const std::vector<double> &);
 template std::vector<int> numerical::argsort<int>(const std::vector<int> &);
-template double numerical::select_uniformly(const std::vector<double> &org, std::mt19937 &rng);
-template int numerical::select_uniformly(const std::vector<int> &org, std::mt19937 &rng);
\ No newline at end of file
+template double numerical::select_uniformly(const std::vector<double> &org, rng::Engine &rng);
+template int numerical::select_uniformly(const std::vector<int> &org, rng::Engine &rng);
\ No newline at end of file
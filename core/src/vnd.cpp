@@ -12,10 +12,15 @@ Solution VND::vnd(
     const Neighborhood::NeighborhoodFactories &neighborhood_factories,
     StepFunction::Func step_function,
     StoppingCriterion &stopping_criterion,
-    int *iteration_ptr)
+    int *iteration_ptr,
+    IncumbentObserver *observer,
+    rng::Engine *engine)
 {
+    RunClock clock;
     Solution sol = initial_sol;
     double f = utils::objective(I, sol);
+    size_t rounds = 0;
+    notify_incumbent(observer, clock, rounds, f, sol);
 
     size_t i = 0;
     size_t K = (size_t)neighborhood_factories.size();
@@ -28,15 +33,20 @@ Solution VND::vnd(
             sol,
             single_neigh,
             step_function,
-            stopping_criterion);
+            stopping_criterion,
+            nullptr,
+            nullptr,
+            engine);
 
         double f_new = utils::objective(I, new_sol);
         i++;
+        rounds++;
         if (f_new < f)
         {
             sol = new_sol;
             f = f_new;
             i = 0;
+            notify_incumbent(observer, clock, rounds, f, sol);
         }
     }
 
@@ -5,6 +5,7 @@
 #include <vector>
 #include <random>
 #include <algorithm>
+#include "rng.hpp"
 namespace fs = std::filesystem;
 
 auto get_instance_paths(const fs::path &folder)
@@ -32,10 +33,9 @@ auto get_some_instance_paths(const fs::path &folder, int num_of_instances)
         return paths;
     }
 
-    std::mt19937 rng(std::random_device{}());
     std::vector<int> indices(paths.size());
     std::iota(indices.begin(), indices.end(), 0);
-    std::shuffle(indices.begin(), indices.end(), rng);
+    std::shuffle(indices.begin(), indices.end(), rng::thread_engine());
 
     std::vector<fs::path> to_return;
     to_return.reserve(num_of_instances);
@@ -83,6 +83,23 @@ ParsedPaths parse_paths(int argc, char **argv)
     return ParsedPaths{instances, output, n};
 }
 
+// Optional seed argument at argv[idx]; if given it is passed to rng::set_seed so a run whose
+// seed was printed can be repeated.
+void parse_seed(int argc, char **argv, int idx)
+{
+    if (argc <= idx)
+        return;
+
+    char *end = nullptr;
+    uint64_t seed = std::strtoull(argv[idx], &end, 10);
+    if (end == argv[idx] || *end != '\0')
+    {
+        std::cerr << "Error: seed must be a non negative integer\n";
+        std::exit(1);
+    }
+    rng::set_seed(seed);
+}
+
 class Timer
 {
     std::chrono::high_resolution_clock::time_point start;
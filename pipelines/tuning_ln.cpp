@@ -34,6 +34,7 @@ struct RES
     int k;
     int bw1;
     int bw2;
+    int rescore; // 0 = beam search for every candidate
     double objective;
     double duration; // ms
     fs::path instance_path;
@@ -50,7 +51,7 @@ void write_csv_results(const fs::path &output_path, const std::vector<RES> &resu
         return;
     }
 
-    out << "path,N,k,bw1,bw2,duration,objective\n";
+    out << "path,N,k,bw1,bw2,rescore,duration,objective\n";
 
     for (const auto &r : results)
     {
@@ -59,6 +60,7 @@ void write_csv_results(const fs::path &output_path, const std::vector<RES> &resu
             << r.k << ","
             << r.bw1 << ","
             << r.bw2 << ","
+            << r.rescore << ","
             << r.duration << ","
             << r.objective << "\n";
     }
@@ -71,25 +73,29 @@ struct combo
     int k;
     int bw1;
     int bw2;
+    int rescore;
 };
 
 combo get_combo(size_t counter, std::vector<int> const &ks, 
-                std::vector<int> const &bw1s, std::vector<int> const &bw2s)
+                std::vector<int> const &bw1s, std::vector<int> const &bw2s,
+                std::vector<int> const &rescores)
 {
     auto Nks = ks.size();
     auto Nbw1s = bw1s.size();
     auto Nbw2s = bw2s.size();
+    auto Nrescores = rescores.size();
 
-    size_t idx_bw2 = counter % Nbw2s;
-    size_t idx_bw1 = (counter / Nbw2s) % Nbw1s;
-    size_t idx_k = counter / (Nbw2s * Nbw1s);
+    size_t idx_rescore = counter % Nrescores;
+    size_t idx_bw2 = (counter / Nrescores) % Nbw2s;
+    size_t idx_bw1 = (counter / (Nrescores * Nbw2s)) % Nbw1s;
+    size_t idx_k = counter / (Nrescores * Nbw2s * Nbw1s);
 
     if (idx_k >= Nks) {
         std::cerr << "Error: counter out of range in get_combo\n";
-        return combo{ks[0], bw1s[0], bw2s[0]};  // Or throw exception
+        return combo{ks[0], bw1s[0], bw2s[0], rescores[0]};  // Or throw exception
     }
 
-    return combo{ks[idx_k], bw1s[idx_bw1], bw2s[idx_bw2]};
+    return combo{ks[idx_k], bw1s[idx_bw1], bw2s[idx_bw2], rescores[idx_rescore]};
 }
 
 
@@ -102,6 +108,7 @@ int main(int argc, char **argv)
     std::vector<int> ks{2};
     std::vector<int> bw1s{5};
     std::vector<int> bw2s{5, 10};
+    std::vector<int> rescores{0, 1, 3}; // 0 = exact, else beam searched candidates per vehicle
     std::vector<RES> all_res;
     std::vector<std::vector<double>> objectives_over_time;
 
@@ -115,7 +122,7 @@ int main(int argc, char **argv)
 
         for (auto const &instance : instance_paths)
         {
-            size_t total_size = ks.size() * bw1s.size() * bw2s.size();
+            size_t total_size = ks.size() * bw1s.size() * bw2s.size() * rescores.size();
             Instance I(instance, "jain");
 
             auto dr_sol = DC::construction(I);
@@ -123,11 +130,11 @@ int main(int argc, char **argv)
             for (size_t counter = 0; counter < total_size; ++counter)
             {
 
-                auto [k, bw1, bw2] = get_combo(counter, ks, bw1s, bw2s);
+                auto [k, bw1, bw2, rescore] = get_combo(counter, ks, bw1s, bw2s, rescores);
                 std::vector<double> objective_over_time;
 
                 Timer t;
-                auto ln_sol = LN::large_neighborhood(I, dr_sol, k, 20, bw1, bw2, &objective_over_time);
+                auto ln_sol = LN::large_neighborhood(I, dr_sol, k, 20, bw1, bw2, &objective_over_time, nullptr, nullptr, rescore);
                 double exec_time = t.get_time();
                 if (!ln_sol.is_solution_feasible(I))
                 {
@@ -142,6 +149,7 @@ int main(int argc, char **argv)
                 res.k = k;
                 res.bw1 = bw1;
                 res.bw2 = bw2;
+                res.rescore = rescore;
                 all_res.push_back(res);
                 objectives_over_time.push_back(objective_over_time);
             }